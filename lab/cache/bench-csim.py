@@ -0,0 +1,68 @@
+#!/usr//bin/python
+#
+# bench-csim.py - Time ./csim on traces/long.trace for E = 1, 2, 4, ...,
+#     256 with each tag compare path (-m scalar, avx2, avx512), and print
+#     the best of several runs of each, and the speedup of the fastest
+#     SIMD path over the scalar one. Paths the CPU lacks print "-".
+#
+import subprocess;
+import time;
+import sys;
+import optparse;
+
+#
+# timeRun - best wall clock time of runs runs of a command, or None if
+# the command fails
+#
+def timeRun(cmd, runs):
+    best = None
+    for i in range(runs):
+        start = time.time()
+        p = subprocess.Popen(cmd, stdout=subprocess.PIPE, stderr=subprocess.PIPE)
+        p.communicate()
+        elapsed = time.time() - start
+        if p.returncode != 0:
+            return None
+        if best is None or elapsed < best:
+            best = elapsed
+    return best
+
+#
+# main - Main function
+#
+def main():
+    p = optparse.OptionParser()
+    p.add_option("-s", dest="s", default="2", help="set index bits");
+    p.add_option("-b", dest="b", default="4", help="block offset bits");
+    p.add_option("-t", dest="trace", default="traces/long.trace",
+                 help="trace file");
+    p.add_option("-r", dest="runs", type="int", default=5,
+                 help="runs per configuration");
+    opts, args = p.parse_args()
+
+    paths = ["scalar", "avx2", "avx512"]
+    sys.stdout.write("%5s" % "E")
+    for path in paths:
+        sys.stdout.write("%10s" % path)
+    sys.stdout.write("%10s\n" % "speedup")
+
+    E = 1
+    while E <= 256:
+        times = []
+        for path in paths:
+            times.append(timeRun(["./csim", "-m", path, "-s", opts.s,
+                                  "-E", str(E), "-b", opts.b,
+                                  "-t", opts.trace], opts.runs))
+        sys.stdout.write("%5d" % E)
+        for t in times:
+            sys.stdout.write("%10s" % ("-" if t is None else "%.3fs" % t))
+        simd = [t for t in times[1:] if t is not None]
+        if times[0] is None or len(simd) == 0:
+            sys.stdout.write("%10s\n" % "-")
+        else:
+            sys.stdout.write("%9.2fx\n" % (times[0] / min(simd)))
+        E = E * 2
+
+# execute main only if called as a script
+if __name__ == "__main__":
+    main()
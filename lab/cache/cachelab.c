@@ -14,12 +14,33 @@ int func_counter = 0;
  * printSummary - Summarize the cache simulation statistics. Student cache simulators
  *                must call this function in order to be properly autograded. 
  */
-void printSummary(int hits, int misses, int evictions)
+void printSummary(unsigned long hits, unsigned long misses,
+                  unsigned long evictions)
 {
-    printf("hits:%d misses:%d evictions:%d\n", hits, misses, evictions);
+    printf("hits:%lu misses:%lu evictions:%lu\n", hits, misses, evictions);
     FILE* output_fp = fopen(".csim_results", "w");
     assert(output_fp);
-    fprintf(output_fp, "%d %d %d\n", hits, misses, evictions);
+    fprintf(output_fp, "%lu %lu %lu\n", hits, misses, evictions);
+    fclose(output_fp);
+}
+
+/*
+ * printLevelSummary - Print one line per level of a cache hierarchy,
+ *                     and save the levels to .csim_levels as
+ *                     "level hits misses evictions writebacks" lines
+ */
+void printLevelSummary(int levels, const level_stats_t *stats)
+{
+    int i;
+    FILE* output_fp = fopen(".csim_levels", "w");
+    assert(output_fp);
+    for (i = 0; i < levels; i++) {
+        printf("L%d hits:%lu misses:%lu evictions:%lu writebacks:%lu\n",
+               i + 1, stats[i].hits, stats[i].misses, stats[i].evictions,
+               stats[i].writebacks);
+        fprintf(output_fp, "%d %lu %lu %lu %lu\n", i + 1, stats[i].hits,
+                stats[i].misses, stats[i].evictions, stats[i].writebacks);
+    }
     fclose(output_fp);
 }
 
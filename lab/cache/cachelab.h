@@ -16,13 +16,43 @@ typedef struct trans_func{
   unsigned int num_evictions;
 } trans_func_t;
 
+/*
+ * LOAD and STORE - Accessors through which transpose functions read
+ * and write A and B, as in STORE(B[j][i], LOAD(A[i][j])). Use STORE
+ * only as a statement. x is evaluated more than once, so it must not
+ * have side effects. Normally they are plain accesses. test-trans
+ * compiles trans.c with -DTRACE_ACCESSES, which makes each of them
+ * also call recordAccess, so the cache can be simulated in-process.
+ */
+#ifdef TRACE_ACCESSES
+#define LOAD(x) (recordAccess(&(x), sizeof(x), 'L'), (x))
+#define STORE(x, v) ((x) = (v), recordAccess(&(x), sizeof(x), 'S'))
+#else
+#define LOAD(x) (x)
+#define STORE(x, v) ((x) = (v))
+#endif
+
+/* Statistics of one level of a cache hierarchy */
+typedef struct level_stats {
+    unsigned long hits;
+    unsigned long misses;
+    unsigned long evictions;
+    unsigned long writebacks;   /* lines written to the level below */
+} level_stats_t;
+
 /* 
  * printSummary - This function provides a standard way for your cache
  * simulator * to display its final hit and miss statistics
  */ 
-void printSummary(int hits,  /* number of  hits */
-				  int misses, /* number of misses */
-				  int evictions); /* number of evictions */
+void printSummary(unsigned long hits,  /* number of  hits */
+				  unsigned long misses, /* number of misses */
+				  unsigned long evictions); /* number of evictions */
+
+/*
+ * printLevelSummary - Display the statistics of each level of a cache
+ * hierarchy, L1 first, and save them to .csim_levels
+ */
+void printLevelSummary(int levels, const level_stats_t *stats);
 
 /* Fill the matrix with data */
 void initMatrix(int M, int N, int A[N][M], int B[M][N]);
@@ -34,4 +64,7 @@ void correctTrans(int M, int N, int A[N][M], int B[M][N]);
 void registerTransFunction(
     void (*trans)(int M,int N,int[N][M],int[M][N]), char* desc);
 
+/* Record one access of a traced transpose function (defined in test-trans.c) */
+void recordAccess(const void *addr, int size, char op);
+
 #endif /* CACHELAB_TOOLS_H */
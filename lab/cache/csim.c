@@ -1,20 +1,33 @@
-#include "cachelab.h"
+#define _POSIX_C_SOURCE 200112L /* posix_memalign, pthreads */
+#include "csim_core.h"
+#include "tracefmt.h"
 
 #include <stdlib.h>
 #include <stdio.h>
 #include <getopt.h>
 #include <stdint.h>
+#include <string.h>
 #include <assert.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <pthread.h>
 
-int s, E, b, verbose = 0;
-int hits = 0, misses = 0, evictions = 0;
-FILE *fp = NULL;
-char filename[20];
+const char *policyNames[NUM_POLICIES] = {
+    "lru", "fifo", "random", "plru", "srrip", "brrip", "opt"
+};
 
-const char *usage = "Usage: %s [-hv] -s <s> -E <E> -b <b> -t <tracefile>\n";
+int s, E, verbose = 0, analyze = 0, threads = 1;
+int policies[NUM_POLICIES], npolicies = 0;  /* all policies given to -p */
+int levelReport = 0;       /* print the counts of every level */
+const char *tracefile = NULL;
+
+const char *usage = "Usage: %s [-hva] [-j <threads>] [-m scalar|avx2|avx512] [-l <s>,<E>]... [-i nine|incl|excl] [-w wb|wt] [-p <policy>[,<policy>]...] [-f next|stride|stream] -s <s> -E <E> -b <b> -t <tracefile>\n";
+const char *simd = NULL;  /* tag compare path forced by -m, else the best */
 void parseArgument(int argc, char *argv[]) {
     int opt;
-    while ((opt = getopt(argc, argv, "hvs:E:b:t:")) != -1) {
+    while ((opt = getopt(argc, argv, "hvaj:m:l:i:w:p:f:s:E:b:t:")) != -1) {
         switch (opt) {
             case 'h':
                 fprintf(stdout, usage, argv[0]);
@@ -22,6 +35,65 @@ void parseArgument(int argc, char *argv[]) {
             case 'v':
                 verbose = 1;
                 break;
+            case 'a':
+                analyze = 1;
+                break;
+            case 'j':
+                threads = atoi(optarg);
+                break;
+            case 'm':
+                simd = optarg;
+                break;
+            case 'l':
+                if (nlevels == MAX_LEVELS ||
+                    sscanf(optarg, "%d,%d", &levelS[nlevels], &levelE[nlevels]) != 2) {
+                    fprintf(stdout, usage, argv[0]);
+                    exit(1);
+                }
+                nlevels++;
+                levelReport = 1;
+                break;
+            case 'i':
+                if (!strcmp(optarg, "nine")) inclusion = NINE;
+                else if (!strcmp(optarg, "incl")) inclusion = INCLUSIVE;
+                else if (!strcmp(optarg, "excl")) inclusion = EXCLUSIVE;
+                else {
+                    fprintf(stdout, usage, argv[0]);
+                    exit(1);
+                }
+                levelReport = 1;
+                break;
+            case 'p':
+                for (char *name = strtok(optarg, ","); name; name = strtok(NULL, ",")) {
+                    int k = 0;
+                    while (k < NUM_POLICIES && strcmp(name, policyNames[k]))
+                        k++;
+                    if (k == NUM_POLICIES || npolicies == NUM_POLICIES) {
+                        fprintf(stdout, usage, argv[0]);
+                        exit(1);
+                    }
+                    policies[npolicies++] = k;
+                }
+                break;
+            case 'f':
+                if (!strcmp(optarg, "none")) prefetcher = PF_NONE;
+                else if (!strcmp(optarg, "next")) prefetcher = PF_NEXT;
+                else if (!strcmp(optarg, "stride")) prefetcher = PF_STRIDE;
+                else if (!strcmp(optarg, "stream")) prefetcher = PF_STREAM;
+                else {
+                    fprintf(stdout, usage, argv[0]);
+                    exit(1);
+                }
+                break;
+            case 'w':
+                if (!strcmp(optarg, "wb")) writeBack = 1;
+                else if (!strcmp(optarg, "wt")) writeBack = 0;
+                else {
+                    fprintf(stdout, usage, argv[0]);
+                    exit(1);
+                }
+                levelReport = 1;
+                break;
             case 's':
                 s = atoi(optarg);
                 break;
@@ -32,7 +104,7 @@ void parseArgument(int argc, char *argv[]) {
                 b = atoi(optarg);
                 break;
             case 't':
-                fp = fopen(optarg, "r");
+                tracefile = optarg;
                 break;
             default:
                 fprintf(stdout, usage, argv[0]);
@@ -41,120 +113,705 @@ void parseArgument(int argc, char *argv[]) {
     }
 }
 
+uint32_t *optNext = NULL; /* OPT: next access to the block of each access */
+uint64_t optTime = 0;     /* OPT: number of the access being simulated */
+
+/*
+ * accessCacheAs - run one access of the trace through the cache under
+ *     policy pol, and print its outcome with -v
+ */
+static inline __attribute__((always_inline))
+void accessCacheAs(int pol, char op, uint64_t address, int sz) {
+    int ret;
+
+    if (pol == OPT && (op == 'L' || op == 'S' || op == 'M'))
+        nextUse = optNext[optTime++];
+    if ((ret = accessOp(pol, op, address)) < 0)
+        return;
+    if (verbose) {
+        if (ret == 0) {
+            printf("%c %lx,%d hit\n", op, address, sz);
+        } else if (ret == 1) {
+            if (op == 'M')
+                printf("%c %lx,%d miss hit\n", op, address, sz);
+            else
+                printf("%c %lx,%d miss\n", op, address, sz);
+        } else {
+            if (op == 'M')
+                printf("%c %lx,%d miss eviction hit\n", op, address, sz);
+            else
+                printf("%c %lx,%d miss eviction\n", op, address, sz);
+        }
+    }
+}
+
+/* accessCache - run one access through the cache under any policy */
+void accessCache(char op, uint64_t address, int sz) {
+    accessCacheAs(policy, op, address, sz);
+}
+
+/* accessCacheLRU - the same, specialized for LRU, the common case */
+void accessCacheLRU(char op, uint64_t address, int sz) {
+    accessCacheAs(LRU, op, address, sz);
+}
+
+/*
+ * Called once per access of a trace, in trace order. The readers are
+ * always inlined, so each caller of readTrace gets a copy of the read
+ * loop with its visit function inlined too.
+ */
+typedef void (*visitFn)(char op, uint64_t address, int sz);
+#define READER static inline __attribute__((always_inline))
+
+/*
+ * readText - pass each access of the text trace in [map, end) to
+ *     visit, parsing it in place with parseTraceLine. A malformed line stops
+ *     the simulation with its line number.
+ */
+READER void readText(const char *map, const char *end, visitFn visit) {
+    const char *p, *nl;
+    unsigned long lineno;
+    uint64_t address;
+    int sz, ret;
+    char op;
+
+    for (p = map, lineno = 1; p < end; lineno++) {
+        if ((ret = parseTraceLine(&p, end, &op, &address, &sz)) < 0) {
+            if ((nl = memchr(p, '\n', end - p)) == NULL)
+                nl = end;
+            fprintf(stderr, "%s:%lu: malformed trace line: %.*s\n",
+                    tracefile, lineno, (int) (nl - p), p);
+            exit(1);
+        }
+        if (ret > 0)
+            visit(op, address, sz);
+    }
+}
+
+/* report a damaged binary trace and exit */
+void badTrace(const char *what, unsigned long block) {
+    fprintf(stderr, "%s: corrupt binary trace: %s in block %lu\n",
+            tracefile, what, block);
+    exit(1);
+}
+
+/*
+ * readBinary - pass each access of the binary trace (tracefmt.h) in
+ *     [map, end) to visit, one block at a time. Each block must hold
+ *     exactly the records and bytes its header claims.
+ */
+READER void readBinary(const unsigned char *map, const unsigned char *end,
+                       visitFn visit) {
+    const unsigned char *p = map + sizeof(traceHdr), *blockEnd;
+    traceHdr hdr;
+    traceBlockHdr bh;
+    traceRegs regs;
+    uint64_t address;
+    int op, sz;
+
+    memcpy(&hdr, map, sizeof(hdr));
+    if (hdr.version != TRACE_VERSION) {
+        fprintf(stderr, "%s: binary trace version %u, expected %d\n",
+                tracefile, hdr.version, TRACE_VERSION);
+        exit(1);
+    }
+    for (unsigned long block = 0; block < hdr.num_blocks; block++) {
+        if ((size_t) (end - p) < sizeof(bh))
+            badTrace("truncated header", block);
+        memcpy(&bh, p, sizeof(bh));
+        p += sizeof(bh);
+        if (bh.bytes > (size_t) (end - p))
+            badTrace("truncated records", block);
+        blockEnd = p + bh.bytes;
+        memset(&regs, 0, sizeof(regs));
+        for (uint32_t i = 0; i < bh.records; i++) {
+            if ((p = decodeRecord(&regs, p, blockEnd, &op, &address, &sz)) == NULL)
+                badTrace("record past the end", block);
+            visit(TRACE_OP_CHAR(op), address, sz);
+        }
+        if (p != blockEnd)
+            badTrace("bytes after the last record", block);
+    }
+    if (p != end)
+        badTrace("data after the last block", hdr.num_blocks);
+}
+
+/*
+ * readTrace - map the trace into memory and pass each of its accesses
+ *     to visit. A trace starting with TRACE_MAGIC is binary, any other
+ *     is text.
+ */
+READER void readTrace(visitFn visit) {
+    int fd;
+    struct stat st;
+    const char *map;
+
+    if ((fd = open(tracefile, O_RDONLY)) < 0 || fstat(fd, &st) < 0) {
+        perror(tracefile);
+        exit(1);
+    }
+    map = "";
+    if (st.st_size > 0) {
+        map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED) {
+            perror(tracefile);
+            exit(1);
+        }
+        posix_madvise((void *) map, st.st_size, POSIX_MADV_SEQUENTIAL);
+    }
+
+    if ((size_t) st.st_size >= sizeof(traceHdr) &&
+        ((const traceHdr *) map)->magic == TRACE_MAGIC)
+        readBinary((const unsigned char *) map,
+                   (const unsigned char *) map + st.st_size, visit);
+    else
+        readText(map, map + st.st_size, visit);
+
+    if (st.st_size > 0)
+        munmap((void *) map, st.st_size);
+    close(fd);
+}
+
+/*
+ * The distinct blocks of a trace, numbered 0, 1, ... in order of first
+ * access through an open-addressed hash table. Used by the stack
+ * distance analysis and by OPT's first pass.
+ */
+#define NO_BLOCK UINT32_MAX
+
+uint64_t *blockKeys = NULL;  /* block addresses */
+uint32_t *blockIds = NULL;   /* their ids, or NO_BLOCK in an empty slot */
+uint64_t blockSlots = 0;     /* slots in the table, a power of two */
+uint32_t numBlocks = 0;      /* distinct blocks */
+
+/*
+ * blockLookup - return the id of block blk, numbering it and setting
+ *     *isNew if it has not been seen before
+ */
+uint32_t blockLookup(uint64_t blk, int *isNew) {
+    uint64_t h, slots, j;
+    uint64_t *keys;
+    uint32_t *ids;
+
+    if (2 * (uint64_t) (numBlocks + 1) > blockSlots) {  /* keep the load under 1/2 */
+        slots = blockSlots ? 2 * blockSlots : 1024;
+        keys = malloc(sizeof(uint64_t) * slots);
+        ids = malloc(sizeof(uint32_t) * slots);
+        if (keys == NULL || ids == NULL || numBlocks == NO_BLOCK - 1) {
+            fprintf(stderr, "out of memory\n");
+            exit(1);
+        }
+        memset(ids, 0xff, sizeof(uint32_t) * slots);
+        for (j = 0; j < blockSlots; j++) {
+            if (blockIds[j] == NO_BLOCK)
+                continue;
+            h = blockKeys[j] * 0x9e3779b97f4a7c15ULL >> 32 & (slots - 1);
+            while (ids[h] != NO_BLOCK)
+                h = (h + 1) & (slots - 1);
+            keys[h] = blockKeys[j];
+            ids[h] = blockIds[j];
+        }
+        free(blockKeys);
+        free(blockIds);
+        blockKeys = keys;
+        blockIds = ids;
+        blockSlots = slots;
+    }
+
+    h = blk * 0x9e3779b97f4a7c15ULL >> 32 & (blockSlots - 1);
+    for (; blockIds[h] != NO_BLOCK; h = (h + 1) & (blockSlots - 1)) {
+        if (blockKeys[h] == blk) {
+            *isNew = 0;
+            return blockIds[h];
+        }
+    }
+    blockKeys[h] = blk;
+    blockIds[h] = numBlocks;
+    *isNew = 1;
+    return numBlocks++;
+}
+
+/* forget all blocks */
+void blockReset() {
+    free(blockKeys);
+    free(blockIds);
+    blockKeys = NULL;
+    blockIds = NULL;
+    blockSlots = 0;
+    numBlocks = 0;
+}
+
+/*
+ * OPT's first pass. optNext[t] is the number of the next access to the
+ * block of access t, counting L, S and M accesses from 0, or NO_BLOCK
+ * if there is none. It is found by numbering the blocks of a first
+ * read of the trace, then scanning the block numbers backwards.
+ */
+uint64_t optCount = 0, optCap = 0;  /* accesses recorded, and room */
+
+/* record the block number of one access */
+void optRecord(char op, uint64_t address, int sz) {
+    int isNew;
+
+    if (op != 'L' && op != 'S' && op != 'M')
+        return;
+    if (optCount == optCap) {
+        optCap = optCap ? 2 * optCap : 1 << 16;
+        if (optCap >= NO_BLOCK || (optNext = realloc(optNext, sizeof(uint32_t) * optCap)) == NULL) {
+            fprintf(stderr, "trace too long for OPT\n");
+            exit(1);
+        }
+    }
+    optNext[optCount++] = blockLookup(address >> b, &isNew);
+}
+
+/* fill in optNext for the trace */
+void optPrepare() {
+    uint32_t *last, id;
+
+    optCount = optTime = 0;
+    readTrace(optRecord);
+    if ((last = malloc(sizeof(uint32_t) * (numBlocks + 1))) == NULL) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    memset(last, 0xff, sizeof(uint32_t) * (numBlocks + 1));
+    for (uint64_t t = optCount; t-- > 0; ) {
+        id = optNext[t];
+        optNext[t] = last[id];
+        last[id] = (uint32_t) t;
+    }
+    free(last);
+    blockReset();
+}
+
+/*
+ * Parallel simulation (-j). Under LRU the sets of a cache never affect
+ * each other, so each of threads workers simulates a contiguous range
+ * of sets on its own, with its own counters. The main thread reads the
+ * trace and hands each access to the worker owning its set, in batches
+ * of BATCH accesses through a ring of QUEUE_BATCHES batches per worker,
+ * so the workers see their accesses in trace order and the locks are
+ * taken once per batch. With -v each worker prints its own accesses, so
+ * lines of different workers interleave arbitrarily.
+ */
+#define BATCH 8192
+#define QUEUE_BATCHES 4
+
+typedef struct {
+    uint64_t address;
+    int32_t sz;
+    char op;
+} traceAccess;
+
 typedef struct {
-    int valid;
-    int lru;
-    uint64_t tag;
-} cacheLine;
-
-typedef cacheLine *cacheSet;
-typedef cacheSet *cache;
-
-int lru_cnt = 0;
-cache my_cache = NULL;
-
-int visitCache(uint64_t address) {
-    lru_cnt++;
-    uint64_t tag = address >> (s + b);
-    uint32_t setIndex = address >> b & ((1 << s) - 1);
-    int hit = 0, miss = 1, evict = 0;
-    for (int i = 0; i < E; i++) {
-        if (my_cache[setIndex][i].valid && my_cache[setIndex][i].tag == tag) {
-            hit = 1;
-            my_cache[setIndex][i].lru = lru_cnt;
+    pthread_t tid;
+    traceAccess *batch[QUEUE_BATCHES];
+    int len[QUEUE_BATCHES];   /* accesses in each full batch */
+    int head, count;          /* oldest full batch, and full batches */
+    int tail, fill;           /* batch the reader is filling, and its accesses */
+    int done;                 /* no more batches will come */
+    pthread_mutex_t lock;
+    pthread_cond_t cond;      /* signalled when count or done changes */
+    level_stats_t stats;      /* the worker's counts, once it is done */
+} worker;
+
+worker *workers = NULL;
+
+/* the worker simulating the set of address: sets are split evenly */
+static inline worker *workerOf(uint64_t address) {
+    uint64_t setIndex = address >> b & ((1ULL << s) - 1);
+    return &workers[(setIndex * threads) >> s];
+}
+
+/* hand the batch being filled by the reader to worker w, waiting for room */
+void pushBatch(worker *w) {
+    pthread_mutex_lock(&w->lock);
+    w->len[w->tail] = w->fill;
+    w->tail = (w->tail + 1) % QUEUE_BATCHES;
+    w->count++;
+    pthread_cond_signal(&w->cond);
+    while (w->count == QUEUE_BATCHES)
+        pthread_cond_wait(&w->cond, &w->lock);
+    pthread_mutex_unlock(&w->lock);
+    w->fill = 0;
+}
+
+/* queue one access for the worker owning its set */
+void scatterAccess(char op, uint64_t address, int sz) {
+    worker *w;
+    traceAccess *a;
+
+    if (op != 'L' && op != 'S' && op != 'M')
+        return;
+    w = workerOf(address);
+    a = &w->batch[w->tail][w->fill];
+    a->address = address;
+    a->sz = sz;
+    a->op = op;
+    if (++w->fill == BATCH)
+        pushBatch(w);
+}
+
+/* simulate the batches of one worker until the reader is done */
+void *workerMain(void *arg) {
+    worker *w = arg;
+    traceAccess *a;
+    int n;
+
+    for (;;) {
+        pthread_mutex_lock(&w->lock);
+        while (w->count == 0 && !w->done)
+            pthread_cond_wait(&w->cond, &w->lock);
+        if (w->count == 0) {
+            pthread_mutex_unlock(&w->lock);
             break;
         }
-    }
-    if (hit) miss = evict = 0;
-    else {
-        int ok = 0;
-        for (int i = 0; i < E; i++) {
-            if (!my_cache[setIndex][i].valid) { // not set
-                my_cache[setIndex][i].lru = lru_cnt;
-                my_cache[setIndex][i].tag = tag;
-                my_cache[setIndex][i].valid = 1;
-                ok = 1;
-                break;
-            }
+        a = w->batch[w->head];
+        n = w->len[w->head];
+        pthread_mutex_unlock(&w->lock);
+
+        for (int i = 0; i < n; i++) {
+            if (policy == LRU)
+                accessCacheLRU(a[i].op, a[i].address, a[i].sz);
+            else
+                accessCache(a[i].op, a[i].address, a[i].sz);
         }
-        if (!ok) {
-            int id = 0, min_lru = 1e9;
-            for (int i = 0; i < E; i++) {
-                if (my_cache[setIndex][i].lru <= min_lru) {
-                    min_lru = my_cache[setIndex][i].lru;
-                    id = i;
-                }
-            }
-            my_cache[setIndex][id].lru = lru_cnt;
-            my_cache[setIndex][id].tag = tag;
-            my_cache[setIndex][id].valid = 1;
-            evict = 1;
+
+        pthread_mutex_lock(&w->lock);
+        w->head = (w->head + 1) % QUEUE_BATCHES;
+        w->count--;
+        pthread_cond_signal(&w->cond);
+        pthread_mutex_unlock(&w->lock);
+    }
+    w->stats = stats[0];
+    return NULL;
+}
+
+/*
+ * simulateParallel - read the trace on this thread and simulate it on
+ *     threads workers, then add up their counts
+ */
+void simulateParallel() {
+    worker *w;
+
+    workers = calloc(threads, sizeof(worker));
+    if (workers == NULL) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    for (w = workers; w < workers + threads; w++) {
+        for (int k = 0; k < QUEUE_BATCHES; k++)
+            w->batch[k] = allocAligned(sizeof(traceAccess) * BATCH);
+        pthread_mutex_init(&w->lock, NULL);
+        pthread_cond_init(&w->cond, NULL);
+        if (pthread_create(&w->tid, NULL, workerMain, w) != 0) {
+            fprintf(stderr, "cannot create worker thread\n");
+            exit(1);
         }
     }
-    hits += hit;
-    misses += miss;
-    evictions += evict;
-    if (hit) return 0;
-    if (evict) return 2;
-    else return 1;
+
+    readTrace(scatterAccess);
+
+    for (w = workers; w < workers + threads; w++) {
+        if (w->fill > 0)
+            pushBatch(w);
+        pthread_mutex_lock(&w->lock);
+        w->done = 1;
+        pthread_cond_signal(&w->cond);
+        pthread_mutex_unlock(&w->lock);
+    }
+    for (w = workers; w < workers + threads; w++) {
+        pthread_join(w->tid, NULL);
+        stats[0].hits += w->stats.hits;
+        stats[0].misses += w->stats.misses;
+        stats[0].evictions += w->stats.evictions;
+        stats[0].writebacks += w->stats.writebacks;
+        for (int k = 0; k < QUEUE_BATCHES; k++)
+            free(w->batch[k]);
+        pthread_mutex_destroy(&w->lock);
+        pthread_cond_destroy(&w->cond);
+    }
+    free(workers);
 }
 
+/*
+ * simulate - run the trace through L1 of 2^s sets of E lines and the
+ *     levels below it, on this thread or, with -j, on threads workers
+ */
 void simulate() {
-    // TODO: malloc
-    int S = 1 << s;
-    uint64_t address;
-    int sz, ret;
-    char buf[20], op;
-
-    my_cache = malloc(sizeof(cacheSet) * S);
-    for (int i = 0; i < S; i++)
-        my_cache[i] = (cacheSet) malloc(sizeof(cacheLine) * E);
-    for (int i = 0; i < S; i++)
-        for (int j = 0; j < E; j++)
-            my_cache[i][j].valid = 0;
-
-    while (fgets(buf, sizeof(buf), fp) != NULL) {
-        if (buf[0] == 'I') continue;
-        sscanf(buf, " %c %lx,%d\n", &op, &address, &sz);
-        switch (op) {
-            case 'S':
-                ret = visitCache(address);
-                break;
-            case 'M':
-                ret = visitCache(address);
-                hits++;
-                break;
-            case 'L':
-                ret = visitCache(address);
-                break;
-            default:
-                break;
+    if (policy == OPT)
+        optPrepare();
+    initCache();
+
+    if (threads > 1)
+        simulateParallel();
+    else if (policy == LRU)
+        readTrace(accessCacheLRU);
+    else
+        readTrace(accessCache);
+
+    freeCache();
+    free(optNext);
+    optNext = NULL;
+    optCap = 0;
+}
+
+/*
+ * Stack distance analysis (-a). One pass over the trace gives the
+ * hits, misses and evictions of LRU caches with 2^0 to 2^s sets and 1
+ * to E ways, for the given b. Under LRU an access hits in an E-way set
+ * exactly when fewer than E other blocks of its set were touched since
+ * the last access to its block (Mattson et al.). For each number of
+ * sets the analysis keeps, per set, the set-local time of the last
+ * access to each block, and a Fenwick tree over those times holding 1
+ * at the times that are still some block's last access. The distance
+ * of an access is then the number of 1s after its block's previous
+ * time, in O(log n). When a set runs out of times, its live times are
+ * renumbered from 1 and the tree is rebuilt.
+ *
+ * A set's lines fill in order and are never invalidated, so a set that
+ * has seen n distinct blocks evicts on all but its first min(n, E)
+ * misses.
+ */
+typedef struct {
+    uint32_t *tree;       /* Fenwick tree over set-local times 1..cap */
+    uint32_t *owner;      /* block last touched at each time, or NO_BLOCK */
+    uint32_t now, cap;    /* last time used, and times in the tree */
+    uint32_t live;        /* distinct blocks seen in the set */
+} sdSet;
+
+#define SD_MIN_CAP 16     /* times in a set's first tree */
+
+int sdLevels;             /* numbers of sets analyzed: 2^0 to 2^(sdLevels-1) */
+sdSet *sdSets[64];        /* the 2^i sets of each level i */
+unsigned long *sdHist;    /* accesses of level i at distance d < E, or d == E for >= E */
+unsigned long sdHits = 0; /* hits that hit in every cache: M's second access */
+
+uint32_t *sdTime;         /* sdTime[id * sdLevels + i]: last time of block id at level i */
+uint32_t sdTimeBlocks = 0; /* blocks sdTime has room for */
+
+/* add v to the count at time t of set st */
+static inline void sdAdd(sdSet *st, uint32_t t, uint32_t v) {
+    for (; t <= st->cap; t += t & -t)
+        st->tree[t] += v;
+}
+
+/* number of live times in 1..t of set st */
+static inline uint32_t sdPrefix(const sdSet *st, uint32_t t) {
+    uint32_t n = 0;
+    for (; t > 0; t -= t & -t)
+        n += st->tree[t];
+    return n;
+}
+
+/*
+ * sdCompact - renumber the live times of set st of level i from 1, in
+ *     order, and rebuild its tree with room for as many new times again
+ */
+void sdCompact(sdSet *st, int i) {
+    uint32_t cap = 2 * st->live + SD_MIN_CAP, n = 0, t, j;
+    uint32_t *owner = malloc(sizeof(uint32_t) * (cap + 1));
+    uint32_t *tree = calloc(cap + 1, sizeof(uint32_t));
+
+    if (owner == NULL || tree == NULL) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    for (t = 1; t <= st->now; t++) {
+        if (st->owner[t] == NO_BLOCK)
+            continue;
+        owner[++n] = st->owner[t];
+        sdTime[(uint64_t) owner[n] * sdLevels + i] = n;
+        tree[n] = 1;
+    }
+    for (t = 1; t <= cap; t++) {   /* linear-time Fenwick build */
+        if ((j = t + (t & -t)) <= cap)
+            tree[j] += tree[t];
+    }
+    free(st->owner);
+    free(st->tree);
+    st->owner = owner;
+    st->tree = tree;
+    st->now = n;
+    st->cap = cap;
+}
+
+/*
+ * sdAccess - record the stack distance of one access at every level
+ */
+void sdAccess(char op, uint64_t address, int sz) {
+    uint64_t blk = address >> b;
+    uint32_t id, t, *last;
+    uint32_t d;
+    int isNew;
+
+    if (op != 'L' && op != 'S' && op != 'M')
+        return;
+    if (op == 'M')
+        sdHits++;
+    id = blockLookup(blk, &isNew);
+    if (id == sdTimeBlocks) {
+        sdTimeBlocks = sdTimeBlocks ? 2 * sdTimeBlocks : 1024;
+        sdTime = realloc(sdTime, sizeof(uint32_t) * sdLevels * sdTimeBlocks);
+        if (sdTime == NULL) {
+            fprintf(stderr, "out of memory\n");
+            exit(1);
         }
-        if (verbose) {
-            if (ret == 0) {
-                printf("%c %lx,%d hit\n", op, address, sz);
-            } else if (ret == 1) {
-                if (op == 'M')
-                    printf("%c %lx,%d miss hit\n", op, address, sz);
-                else
-                    printf("%c %lx,%d miss\n", op, address, sz);
-            } else {
-                if (op == 'M')
-                    printf("%c %lx,%d miss eviction hit\n", op, address, sz);
-                else
-                    printf("%c %lx,%d miss eviction\n", op, address, sz);
-            }
+    }
+    last = &sdTime[(uint64_t) id * sdLevels];
+
+    for (int i = 0; i < sdLevels; i++) {
+        sdSet *st = &sdSets[i][blk & ((1ULL << i) - 1)];
+
+        if (st->now == st->cap)
+            sdCompact(st, i);
+        if (isNew) {
+            d = E;
+            st->live++;
+        } else {
+            d = st->live - sdPrefix(st, last[i]);
+            sdAdd(st, last[i], -1);
+            st->owner[last[i]] = NO_BLOCK;
+        }
+        t = ++st->now;
+        sdAdd(st, t, 1);
+        st->owner[t] = id;
+        last[i] = t;
+        sdHist[i * (E + 1) + (d < (uint32_t) E ? d : (uint32_t) E)]++;
+    }
+}
+
+/*
+ * analyzeTrace - run the stack distance analysis and print the hits,
+ *     misses and evictions of every cache with up to 2^s sets and E ways
+ */
+void analyzeTrace() {
+    unsigned long hits, misses, full, *sets;
+
+    sdLevels = s + 1;
+    sdHist = calloc((size_t) sdLevels * (E + 1), sizeof(unsigned long));
+    sets = malloc(sizeof(unsigned long) * (E + 1));
+    for (int i = 0; i < sdLevels; i++)
+        sdSets[i] = calloc(1ULL << i, sizeof(sdSet));
+    if (sdHist == NULL || sets == NULL) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    for (int i = 0; i < sdLevels; i++) {
+        if (sdSets[i] == NULL) {
+            fprintf(stderr, "out of memory\n");
+            exit(1);
+        }
+    }
+
+    readTrace(sdAccess);
+
+    for (int i = 0; i < sdLevels; i++) {
+        /* sets[n] sets of this level saw n distinct blocks, or E or more for n == E */
+        memset(sets, 0, sizeof(unsigned long) * (E + 1));
+        for (uint64_t j = 0; j < (1ULL << i); j++)
+            sets[sdSets[i][j].live < (uint32_t) E ? sdSets[i][j].live : (uint32_t) E]++;
+
+        hits = sdHits;
+        misses = 0;
+        for (int d = 0; d <= E; d++)
+            misses += sdHist[i * (E + 1) + d];
+        for (int e = 1; e <= E; e++) {
+            hits += sdHist[i * (E + 1) + e - 1];
+            misses -= sdHist[i * (E + 1) + e - 1];
+            full = 0;   /* misses that filled an empty line */
+            for (int n = 0; n <= E; n++)
+                full += sets[n] * (n < e ? n : e);
+            printf("s:%d E:%d b:%d hits:%lu misses:%lu evictions:%lu\n",
+                   i, e, b, hits, misses, misses - full);
         }
     }
 
-    for (int i = 0; i < S; i++)
-        free(my_cache[i]);
-    free(my_cache);
+    for (int i = 0; i < sdLevels; i++) {
+        for (uint64_t j = 0; j < (1ULL << i); j++) {
+            free(sdSets[i][j].tree);
+            free(sdSets[i][j].owner);
+        }
+        free(sdSets[i]);
+    }
+    free(sdHist);
+    free(sets);
+    free(sdTime);
+    blockReset();
 }
 
 int main(int argc, char **argv) {
     parseArgument(argc, argv);
-    simulate();
-    printSummary(hits, misses, evictions);
+    if (tracefile == NULL || s < 0 || E < 1 || b < 0 || s + b > 63 || threads < 1) {
+        fprintf(stdout, usage, argv[0]);
+        exit(1);
+    }
+    for (int i = 1; i < nlevels; i++) {
+        if (levelS[i] < 0 || levelE[i] < 1 || levelS[i] + b > 63) {
+            fprintf(stdout, usage, argv[0]);
+            exit(1);
+        }
+    }
+    if (threads > 1 && nlevels > 1) {
+        fprintf(stderr, "-j simulates a single level only\n");
+        exit(1);
+    }
+    if (inclusion == EXCLUSIVE && !writeBack) {
+        fprintf(stderr, "-i excl needs -w wb\n");
+        exit(1);
+    }
+    if (prefetcher != PF_NONE && (threads > 1 || analyze)) {
+        fprintf(stderr, "-f does not work with -j or -a\n");
+        exit(1);
+    }
+    if (prefetcher == PF_STREAM && inclusion == EXCLUSIVE) {
+        fprintf(stderr, "-f stream does not work with -i excl\n");
+        exit(1);
+    }
+    if (npolicies == 0)
+        policies[npolicies++] = LRU;
+    levelS[0] = s;
+    levelE[0] = E;
+    for (int k = 0; k < npolicies; k++) {
+        if (policies[k] == OPT && (nlevels > 1 || threads > 1 || prefetcher != PF_NONE)) {
+            fprintf(stderr, "-p opt simulates a single level on one thread, without -f\n");
+            exit(1);
+        }
+        if (policies[k] != LRU && analyze) {
+            fprintf(stderr, "-a analyzes LRU only\n");
+            exit(1);
+        }
+        for (int i = 0; i < nlevels && policies[k] == PLRU; i++) {
+            if (levelE[i] > 64 || (levelE[i] & (levelE[i] - 1))) {
+                fprintf(stderr, "-p plru needs E a power of two up to 64\n");
+                exit(1);
+            }
+        }
+    }
+    if (s < 62 && (uint64_t) threads > 1ULL << s)
+        threads = 1 << s;   /* a worker per set at most */
+    if (analyze) {
+        analyzeTrace();
+        return 0;
+    }
+    selectSimd(simd);
+
+    /* one policy reports as usual; several print a line each, side by side */
+    for (int k = 0; k < npolicies; k++) {
+        policy = policies[k];
+        memset(stats, 0, sizeof(stats));
+        simulate();
+        if (npolicies == 1)
+            printSummary(stats[0].hits, stats[0].misses, stats[0].evictions);
+        else
+            printf("%-6s hits:%lu misses:%lu evictions:%lu\n", policyNames[policy],
+                   stats[0].hits, stats[0].misses, stats[0].evictions);
+        if (prefetcher != PF_NONE)
+            printf("prefetches:%lu useful:%lu useless:%lu\n",
+                   pfStats.prefetches, pfStats.useful, pfStats.useless);
+        if (levelReport)
+            printLevelSummary(nlevels, stats);
+    }
     return 0;
 }
@@ -0,0 +1,535 @@
+/*
+ * csim_core.c - The cache engine shared by csim and test-trans. The
+ *     hot path, accessLevel, is inline in csim_core.h; this file holds
+ *     the rest: the tag compare paths, fills and evictions, and the
+ *     prefetchers.
+ */
+#define _POSIX_C_SOURCE 200112L /* posix_memalign */
+#include "csim_core.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <immintrin.h>
+
+int b;
+int policy = LRU;
+int prefetcher = PF_NONE;
+int nlevels = 1;
+int levelS[MAX_LEVELS], levelE[MAX_LEVELS];
+int inclusion = NINE, writeBack = 1;
+
+cacheLevel levels[MAX_LEVELS];
+
+/* per thread, so -j workers count on their own; 64-bit on x86-64 */
+__thread level_stats_t stats[MAX_LEVELS];
+
+uint32_t nextUse;
+prefetchStats pfStats;
+int pfTagHit;
+
+/* allocate n bytes aligned to a host cache line, or exit */
+void *allocAligned(size_t n) {
+    void *p;
+    if (posix_memalign(&p, CACHE_ALIGN, n) != 0) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    return p;
+}
+
+/* return the way of the first n ways in t holding tag, or -1 */
+int findWayScalar(const uint64_t *t, int n, uint64_t tag) {
+    for (int way = 0; way < n; way++)
+        if (t[way] == tag)
+            return way;
+    return -1;
+}
+
+/* compare 4 ways per instruction; may read up to 3 ways past n */
+__attribute__((target("avx2")))
+int findWayAVX2(const uint64_t *t, int n, uint64_t tag) {
+    __m256i key = _mm256_set1_epi64x((long long) tag);
+    int found = -1;
+    for (int way = 0; way < n; way += 4) {
+        __m256i v = _mm256_load_si256((const __m256i *) (t + way));
+        int mask = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(v, key)));
+        if (mask) {
+            found = way + __builtin_ctz(mask);
+            break;
+        }
+    }
+    _mm256_zeroupper(); /* the rest of csim is SSE code */
+    return found;
+}
+
+/* compare 8 ways per instruction; may read up to 7 ways past n */
+__attribute__((target("avx512f,avx")))
+int findWayAVX512(const uint64_t *t, int n, uint64_t tag) {
+    __m512i key = _mm512_set1_epi64((long long) tag);
+    int found = -1;
+    for (int way = 0; way < n; way += 8) {
+        __mmask8 mask = _mm512_cmpeq_epi64_mask(_mm512_load_si512(t + way), key);
+        if (mask) {
+            found = way + __builtin_ctz(mask);
+            break;
+        }
+    }
+    _mm256_zeroupper();
+    return found;
+}
+
+int (*findWay)(const uint64_t *t, int n, uint64_t tag) = findWayScalar;
+
+/* pick the tag compare path named simd, or the widest the CPU has if NULL */
+void selectSimd(const char *simd) {
+    __builtin_cpu_init();
+    if (simd == NULL)
+        simd = __builtin_cpu_supports("avx512f") ? "avx512"
+             : __builtin_cpu_supports("avx2") ? "avx2" : "scalar";
+    if (!strcmp(simd, "avx512") && __builtin_cpu_supports("avx512f"))
+        findWay = findWayAVX512;
+    else if (!strcmp(simd, "avx2") && __builtin_cpu_supports("avx2"))
+        findWay = findWayAVX2;
+    else if (!strcmp(simd, "scalar"))
+        findWay = findWayScalar;
+    else {
+        fprintf(stderr, "%s: tag compare path not available\n", simd);
+        exit(1);
+    }
+}
+
+/* allocate level c with 2^s sets of E empty ways */
+void initLevel(cacheLevel *c, int s, int E) {
+    uint64_t S = 1ULL << s;
+
+    c->s = s;
+    c->E = E;
+    c->Ep = (E + WAY_PAD - 1) / WAY_PAD * WAY_PAD;
+    c->tags = allocAligned(sizeof(uint64_t) * S * c->Ep);
+    c->lines = allocAligned(sizeof(cacheLine) * S * c->Ep);
+    c->dirty = allocAligned(S * c->Ep);
+    c->pf = allocAligned(S * c->Ep);
+    c->meta = allocAligned(sizeof(uint32_t) * S * c->Ep);
+    c->plru = allocAligned(sizeof(uint64_t) * S);
+    c->rng = allocAligned(sizeof(uint64_t) * S);
+    c->sets = allocAligned(sizeof(cacheSet) * S);
+    memset(c->plru, 0, sizeof(uint64_t) * S);
+    memset(c->pf, 0, S * c->Ep);
+    memset(c->tags, 0xff, sizeof(uint64_t) * S * c->Ep); /* all INVALID_TAG */
+    for (uint64_t i = 0; i < S; i++) {
+        c->sets[i].head = c->sets[i].tail = -1;
+        c->sets[i].fill = 0;
+        c->rng[i] = (i + 1) * 0x9e3779b97f4a7c15ULL;  /* nonzero, and differs per set */
+    }
+}
+
+void freeLevel(cacheLevel *c) {
+    free(c->tags);
+    free(c->lines);
+    free(c->dirty);
+    free(c->pf);
+    free(c->meta);
+    free(c->plru);
+    free(c->rng);
+    free(c->sets);
+}
+
+/* set the state of policy pol for way, just filled */
+static inline void placeLine(int pol, cacheLevel *c, uint64_t setIndex, int way) {
+    switch (pol) {
+        case PLRU:
+            plruTouch(c, setIndex, way);
+            break;
+        case SRRIP:
+            c->meta[setIndex * c->Ep + way] = RRPV_MAX - 1;
+            break;
+        case BRRIP:
+            c->meta[setIndex * c->Ep + way] =
+                nextRandom(&c->rng[setIndex]) % BRRIP_LONG ? RRPV_MAX : RRPV_MAX - 1;
+            break;
+        case OPT:
+            c->meta[setIndex * c->Ep + way] = nextUse;
+            break;
+    }
+}
+
+/* choose the way policy pol evicts from a full set */
+static inline int victimWay(int pol, cacheLevel *c, uint64_t setIndex) {
+    uint32_t *m = &c->meta[setIndex * c->Ep], max = 0;
+    uint64_t bits;
+    int way = 0, node;
+
+    switch (pol) {
+        case RANDOM:
+            return (int) (nextRandom(&c->rng[setIndex]) % c->E);
+        case PLRU:
+            bits = c->plru[setIndex];
+            for (node = 1; node < c->E; )
+                node = 2 * node + (int) (bits >> node & 1);
+            return node - c->E;
+        case SRRIP:
+        case BRRIP:
+        case OPT:
+            /* the first way with the largest RRPV or next use */
+            for (int w = 0; w < c->E; w++) {
+                if (m[w] > max) {
+                    max = m[w];
+                    way = w;
+                }
+            }
+            if (pol != OPT && max < RRPV_MAX) {
+                for (int w = 0; w < c->E; w++)   /* age until one is RRPV_MAX */
+                    m[w] += RRPV_MAX - max;
+            }
+            return way;
+        default:
+            return c->sets[setIndex].tail;
+    }
+}
+
+/*
+ * insertLine - put address in a free way of its set in level c, or in
+ *     place of the victim policy pol picks. Returns 1, or 2 if a line
+ *     was evicted, with its address and dirty flag in *victim and
+ *     *victimDirty.
+ */
+static inline int insertLine(int pol, cacheLevel *c, uint64_t address, int dirty,
+                             uint64_t *victim, int *victimDirty) {
+    uint64_t setIndex = setOf(c, address);
+    cacheSet *set = &c->sets[setIndex];
+    uint64_t *t = &c->tags[setIndex * c->Ep];
+    cacheLine *ln = &c->lines[setIndex * c->Ep];
+    uint8_t *d = &c->dirty[setIndex * c->Ep];
+    int way, ret = 1;
+
+    if (set->fill < c->E) {
+        way = set->fill++;
+    } else {
+        way = victimWay(pol, c, setIndex);
+        *victim = (t[way] << c->s | setIndex) << b;
+        *victimDirty = d[way];
+        if (c->pf[setIndex * c->Ep + way])
+            pfStats.useless++;
+        unlinkWay(set, ln, way);
+        ret = 2;
+    }
+    t[way] = address >> (c->s + b);
+    d[way] = (uint8_t) dirty;
+    c->pf[setIndex * c->Ep + way] = 0;
+    pushFront(set, ln, way);
+    placeLine(pol, c, setIndex, way);
+    return ret;
+}
+
+/*
+ * removeLine - invalidate address in level c, keeping the valid ways
+ *     of its set first. Under PLRU, whose tree bits name ways, moving a
+ *     way rebuilds them by touching the ways in the order the recency
+ *     list keeps. Returns the line's dirty flag, or -1 if it was not
+ *     there.
+ */
+static int removeLine(int pol, cacheLevel *c, uint64_t address) {
+    uint64_t setIndex = setOf(c, address);
+    cacheSet *set = &c->sets[setIndex];
+    uint64_t *t = &c->tags[setIndex * c->Ep];
+    cacheLine *ln = &c->lines[setIndex * c->Ep];
+    uint8_t *d = &c->dirty[setIndex * c->Ep];
+    int way, last, dirty;
+
+    if ((way = findWay(t, set->fill, address >> (c->s + b))) < 0)
+        return -1;
+    dirty = d[way];
+    if (c->pf[setIndex * c->Ep + way])
+        pfStats.useless++;
+    unlinkWay(set, ln, way);
+    last = --set->fill;
+    if (way != last) {
+        t[way] = t[last];
+        d[way] = d[last];
+        c->pf[setIndex * c->Ep + way] = c->pf[setIndex * c->Ep + last];
+        c->meta[setIndex * c->Ep + way] = c->meta[setIndex * c->Ep + last];
+        ln[way] = ln[last];
+        if (ln[way].prev >= 0) ln[ln[way].prev].next = way;
+        else set->head = way;
+        if (ln[way].next >= 0) ln[ln[way].next].prev = way;
+        else set->tail = way;
+        if (pol == PLRU) {
+            c->plru[setIndex] = 0;
+            for (int w = set->tail; w >= 0; w = ln[w].prev)
+                plruTouch(c, setIndex, w);
+        }
+    }
+    t[last] = INVALID_TAG;
+    return dirty;
+}
+
+/* write address from level i to the level below it, or to memory */
+void writeDown(int i, uint64_t address) {
+    stats[i].writebacks++;
+    if (i + 1 < nlevels)
+        accessBelow(i + 1, address, 1);
+}
+
+/* deal with line victim just evicted from level i under policy pol */
+static void evictLine(int pol, int i, uint64_t victim, int dirty) {
+    int d;
+
+    stats[i].evictions++;
+    if (inclusion == INCLUSIVE) {
+        for (int j = 0; j < i; j++)
+            if ((d = removeLine(pol, &levels[j], victim)) > 0)
+                dirty = 1;
+    }
+    if (inclusion == EXCLUSIVE && i + 1 < nlevels) {
+        if (dirty)
+            stats[i].writebacks++;
+        fillLine(pol, i + 1, victim, dirty);
+    } else if (dirty) {
+        writeDown(i, victim);
+    }
+}
+
+/* put address in level i under policy pol; returns 1, or 2 if that
+   evicted a line */
+int fillLine(int pol, int i, uint64_t address, int dirty) {
+    uint64_t victim;
+    int victimDirty;
+
+    if (insertLine(pol, &levels[i], address, dirty, &victim, &victimDirty) == 1)
+        return 1;
+    evictLine(pol, i, victim, victimDirty);
+    return 2;
+}
+
+/*
+ * takeLine - look for address in levels i and below, counting a hit or
+ *     a miss in each level searched, and take it out of the first that
+ *     has it. Returns its dirty flag (0 if it came from memory).
+ */
+int takeLine(int pol, int i, uint64_t address) {
+    int dirty;
+
+    for (; i < nlevels; i++) {
+        if ((dirty = removeLine(pol, &levels[i], address)) >= 0) {
+            stats[i].hits++;
+            return dirty;
+        }
+        stats[i].misses++;
+    }
+    return 0;
+}
+
+int accessBelow(int i, uint64_t address, int write) {
+    return accessLevel(policy, i, address, write);
+}
+
+/*
+ * Prefetchers (-f). They watch the demand accesses to L1 and fetch
+ * lines before they are asked for:
+ *
+ *     next    tagged next-line: a miss to block B, or the first hit
+ *             on a line brought in by a prefetch, prefetches B + 1
+ *     stride  without PCs, accesses are grouped by their 4 KB region.
+ *             A table of STRIDE_ENTRIES regions, replaced LRU, holds
+ *             the last block and stride seen in each; once the same
+ *             nonzero stride is seen STRIDE_CONFIDENT times in a row,
+ *             each access prefetches the next PF_DEGREE blocks along it
+ *     stream  Jouppi's stream buffers: STREAM_BUFFERS FIFOs of the
+ *             STREAM_DEPTH blocks after a miss, kept outside the cache.
+ *             An L1 miss found in a buffer is a hit: the line moves
+ *             into L1, the blocks ahead of it are dropped, and the
+ *             buffer is topped up. Other misses restart the least
+ *             recently used buffer.
+ *
+ * next and stride fill prefetched lines into L1 like demand misses,
+ * flagged in pf until their first use. A prefetch of a line L1 already
+ * holds is not issued. Prefetches fetch from the levels below, so
+ * their traffic shows up there. A prefetch is useful if it is used
+ * before it is evicted or dropped, and useless otherwise, counting
+ * those still unused when the trace ends. Evictions include lines
+ * evicted by prefetches.
+ */
+#define REGION_BITS 12
+#define STRIDE_ENTRIES 16
+#define STRIDE_CONFIDENT 2
+#define PF_DEGREE 2
+#define STREAM_BUFFERS 4
+#define STREAM_DEPTH 4
+
+typedef struct {
+    uint64_t region;      /* address >> REGION_BITS */
+    uint64_t last;        /* last block accessed in the region */
+    int64_t stride;       /* last difference between its blocks */
+    int confidence;       /* times in a row the stride repeated */
+    unsigned long used;   /* for LRU replacement of entries */
+} strideEntry;
+
+typedef struct {
+    uint64_t blk[STREAM_DEPTH];  /* prefetched blocks, oldest first */
+    int head, count;
+    uint64_t next;               /* next block to prefetch */
+    unsigned long used;          /* for LRU replacement of buffers */
+} streamBuffer;
+
+strideEntry strideTable[STRIDE_ENTRIES];
+streamBuffer streams[STREAM_BUFFERS];
+unsigned long pfClock;           /* demand accesses seen */
+
+/* fetch a line for the prefetcher from below L1, or from memory */
+static int fetchBelow(uint64_t address) {
+    pfStats.prefetches++;
+    if (nlevels == 1)
+        return 0;
+    if (inclusion == EXCLUSIVE)
+        return takeLine(policy, 1, address);
+    accessBelow(1, address, 0);
+    return 0;
+}
+
+/* prefetch the line of address into L1, unless it is there */
+static void prefetchLine(uint64_t address) {
+    cacheLevel *c = &levels[0];
+    uint64_t setIndex = setOf(c, address);
+
+    if (findWay(&c->tags[setIndex * c->Ep], c->sets[setIndex].fill,
+                address >> (c->s + b)) >= 0)
+        return;
+    fillLine(policy, 0, address, fetchBelow(address));
+    c->pf[setIndex * c->Ep + c->sets[setIndex].head] = 1;  /* the new line */
+}
+
+/* train the stride table on a demand access, and prefetch along it */
+static void strideAccess(uint64_t address) {
+    uint64_t blk = address >> b, region = address >> REGION_BITS;
+    strideEntry *e = &strideTable[0];
+    int64_t d;
+
+    for (int k = 0; k < STRIDE_ENTRIES; k++) {
+        if (strideTable[k].used && strideTable[k].region == region) {
+            e = &strideTable[k];
+            break;
+        }
+        if (strideTable[k].used < e->used)
+            e = &strideTable[k];
+    }
+    if (!e->used || e->region != region) {
+        e->region = region;
+        e->last = blk;
+        e->stride = 0;
+        e->confidence = 0;
+        e->used = pfClock;
+        return;
+    }
+    e->used = pfClock;
+    d = (int64_t) (blk - e->last);
+    if (d == 0)
+        return;   /* same block again */
+    if (d == e->stride) {
+        if (e->confidence < STRIDE_CONFIDENT)
+            e->confidence++;
+    } else {
+        e->stride = d;
+        e->confidence = 0;
+    }
+    e->last = blk;
+    if (e->confidence == STRIDE_CONFIDENT) {
+        for (int k = 1; k <= PF_DEGREE; k++)
+            prefetchLine((blk + k * d) << b);
+    }
+}
+
+/* top up stream buffer sb to STREAM_DEPTH blocks */
+static void streamFill(streamBuffer *sb) {
+    while (sb->count < STREAM_DEPTH) {
+        fetchBelow(sb->next << b);
+        sb->blk[(sb->head + sb->count++) % STREAM_DEPTH] = sb->next++;
+    }
+}
+
+/*
+ * streamHit - look for the block of address in the stream buffers. If
+ *     found, drop it and the blocks ahead of it, top the buffer up and
+ *     return 1.
+ */
+int streamHit(uint64_t address) {
+    uint64_t blk = address >> b;
+
+    for (streamBuffer *sb = streams; sb < streams + STREAM_BUFFERS; sb++) {
+        for (int k = 0; k < sb->count; k++) {
+            if (sb->blk[(sb->head + k) % STREAM_DEPTH] != blk)
+                continue;
+            pfStats.useful++;
+            pfStats.useless += k;
+            sb->head = (sb->head + k + 1) % STREAM_DEPTH;
+            sb->count -= k + 1;
+            sb->used = pfClock;
+            streamFill(sb);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* restart the least recently used stream buffer after a miss */
+void streamAllocate(uint64_t address) {
+    streamBuffer *sb = streams;
+
+    for (int k = 1; k < STREAM_BUFFERS; k++)
+        if (streams[k].used < sb->used)
+            sb = &streams[k];
+    pfStats.useless += sb->count;
+    sb->head = sb->count = 0;
+    sb->next = (address >> b) + 1;
+    sb->used = pfClock;
+    streamFill(sb);
+}
+
+/* run the next-line or stride prefetcher after a demand access to L1 */
+void prefetchAfter(uint64_t address, int ret) {
+    pfClock++;
+    if (prefetcher == PF_NEXT && (ret != 0 || pfTagHit))
+        prefetchLine(((address >> b) + 1) << b);
+    else if (prefetcher == PF_STRIDE)
+        strideAccess(address);
+    pfTagHit = 0;
+}
+
+/* forget the prefetcher state before a run */
+void prefetchReset(void) {
+    memset(&pfStats, 0, sizeof(pfStats));
+    memset(strideTable, 0, sizeof(strideTable));
+    memset(streams, 0, sizeof(streams));
+    pfClock = 1;
+    pfTagHit = 0;
+}
+
+/* count the prefetches still unused at the end as useless */
+void prefetchFinish(void) {
+    cacheLevel *c = &levels[0];
+
+    for (uint64_t i = 0; i < (1ULL << c->s); i++)
+        for (int way = 0; way < c->sets[i].fill; way++)
+            pfStats.useless += c->pf[i * c->Ep + way];
+    for (int k = 0; k < STREAM_BUFFERS; k++)
+        pfStats.useless += streams[k].count;
+}
+
+/* allocate the nlevels empty levels of levelS and levelE sets and ways */
+void initCache(void) {
+    prefetchReset();
+    for (int i = 0; i < nlevels; i++)
+        initLevel(&levels[i], levelS[i], levelE[i]);
+}
+
+/* count the prefetches left unused, then free the levels */
+void freeCache(void) {
+    prefetchFinish();
+    for (int i = 0; i < nlevels; i++)
+        freeLevel(&levels[i]);
+}
+
+/* cacheAccess - run one access through the cache under policy */
+int cacheAccess(char op, uint64_t address) {
+    return accessOp(policy, op, address);
+}
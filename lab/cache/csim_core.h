@@ -0,0 +1,308 @@
+/*
+ * csim_core.h - The cache engine of csim: the levels of the hierarchy,
+ *     their replacement policies and the L1 prefetchers. csim drives it
+ *     from a trace and test-trans from the accesses it records; both
+ *     set the globals below, then call initCache, accessOp or
+ *     cacheAccess for each access, and freeCache.
+ */
+#ifndef CSIM_CORE_H
+#define CSIM_CORE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "cachelab.h"
+
+#define MAX_LEVELS 4       /* L1 and up to three levels below it */
+#define NINE 0             /* inclusion policies of the levels below L1 */
+#define INCLUSIVE 1
+#define EXCLUSIVE 2
+
+#define LRU 0              /* replacement policies, selected with -p */
+#define FIFO 1
+#define RANDOM 2
+#define PLRU 3
+#define SRRIP 4
+#define BRRIP 5
+#define OPT 6
+#define NUM_POLICIES 7
+
+#define PF_NONE 0          /* L1 prefetchers, selected with -f */
+#define PF_NEXT 1
+#define PF_STRIDE 2
+#define PF_STREAM 3
+
+/*
+ * Each cache level lives in flat arrays indexed by set * Ep + way, where
+ * Ep is E rounded up to WAY_PAD, so a set's lines are contiguous. Tags
+ * are kept apart from the LRU links so the lookup scans nothing but
+ * tags. An invalid way holds INVALID_TAG, which no address can produce
+ * unless s + b == 0, so the lookup needs no valid bits and may compare
+ * whole vectors of ways past the last valid one. The valid ways of a
+ * set are always ways 0 to fill - 1: a set fills its ways in order,
+ * and a way invalidated by another level is filled by moving the last
+ * valid way into it. Each set keeps its ways on a doubly linked
+ * recency list, most recently used first: a hit moves its way to the
+ * front and a miss in a full set evicts the way at the back, both in
+ * O(1).
+ */
+typedef struct {
+    int32_t prev, next;   /* neighbouring ways on the recency list */
+} cacheLine;
+
+typedef struct {
+    int32_t head, tail;   /* most and least recently used ways */
+    int32_t fill;         /* number of valid ways */
+} cacheSet;
+
+#define CACHE_ALIGN 64    /* host cache line size */
+#define WAY_PAD 8         /* ways compared per AVX-512 instruction */
+#define INVALID_TAG UINT64_MAX
+
+/* A cache level of 2^s sets of E ways. All levels share the block size b */
+typedef struct {
+    int s, E, Ep;         /* Ep is E rounded up to WAY_PAD */
+    uint64_t *tags;       /* S * Ep tags */
+    cacheLine *lines;     /* S * Ep recency links */
+    uint8_t *dirty;       /* S * Ep dirty flags */
+    uint8_t *pf;          /* S * Ep: prefetched and not used yet */
+    uint32_t *meta;       /* S * Ep: RRPV for RRIP, next use for OPT */
+    uint64_t *plru;       /* S: the tree bits of PLRU */
+    uint64_t *rng;        /* S: random state of each set, for random and BRRIP */
+    cacheSet *sets;       /* S sets */
+} cacheLevel;
+
+/* Prefetches into L1 or the stream buffers, and how many were used */
+typedef struct {
+    unsigned long prefetches;  /* lines fetched by the prefetcher */
+    unsigned long useful;      /* of them, accessed before being dropped */
+    unsigned long useless;     /* evicted, or still unused at the end */
+} prefetchStats;
+
+/* The hierarchy being simulated, set up before initCache */
+extern int b;              /* block bits, shared by all levels */
+extern int policy;         /* the policy being simulated */
+extern int prefetcher;
+extern int nlevels;        /* levels of the hierarchy, L1 first */
+extern int levelS[MAX_LEVELS], levelE[MAX_LEVELS];
+extern int inclusion, writeBack;
+
+extern cacheLevel levels[MAX_LEVELS];
+extern __thread level_stats_t stats[MAX_LEVELS];
+extern uint32_t nextUse;   /* OPT: next use of the block being accessed */
+extern prefetchStats pfStats;
+extern int pfTagHit;       /* the last L1 hit was the first use of a prefetch */
+extern int (*findWay)(const uint64_t *t, int n, uint64_t tag);
+
+void *allocAligned(size_t n);
+void selectSimd(const char *simd);
+void initLevel(cacheLevel *c, int s, int E);
+void freeLevel(cacheLevel *c);
+void initCache(void);
+void freeCache(void);
+int cacheAccess(char op, uint64_t address);
+
+/* unlink way from the recency list of set */
+static inline void unlinkWay(cacheSet *set, cacheLine *ln, int way) {
+    if (ln[way].prev >= 0) ln[ln[way].prev].next = ln[way].next;
+    else set->head = ln[way].next;
+    if (ln[way].next >= 0) ln[ln[way].next].prev = ln[way].prev;
+    else set->tail = ln[way].prev;
+}
+
+/* make way the most recently used of set */
+static inline void pushFront(cacheSet *set, cacheLine *ln, int way) {
+    ln[way].prev = -1;
+    ln[way].next = set->head;
+    if (set->head >= 0) ln[set->head].prev = way;
+    else set->tail = way;
+    set->head = way;
+}
+
+/* the set index of address in level c */
+static inline uint64_t setOf(const cacheLevel *c, uint64_t address) {
+    return address >> b & ((1ULL << c->s) - 1);
+}
+
+/*
+ * Replacement policies. Every policy fills the free ways of a set
+ * first, and keeps the recency list, which LRU and FIFO evict from:
+ *
+ *     lru     evict the least recently used way (default)
+ *     fifo    evict the way filled longest ago: hits do not reorder
+ *     random  evict a random way
+ *     plru    tree pseudo-LRU: E - 1 bits per set (E a power of two
+ *             up to 64) form a binary tree whose bits point away from
+ *             the most recently used half at each node; the victim is
+ *             found by following them
+ *     srrip   static re-reference interval prediction: a 2-bit RRPV
+ *             per way, 0 on a hit, RRPV_MAX - 1 on a fill; evict the
+ *             first way at RRPV_MAX, ageing all ways until one is
+ *     brrip   bimodal RRIP: as srrip, but fills at RRPV_MAX except for
+ *             one in BRRIP_LONG, so a scan does not flush the set
+ *     opt     Belady's optimal policy, offline: evict the way whose
+ *             next access is furthest away, using the next use the
+ *             caller puts in nextUse before each access, from a first
+ *             pass over the trace. Single level only.
+ */
+#define RRPV_MAX 3
+#define BRRIP_LONG 32
+
+/*
+ * xorshift64* on the state of one set. Each set draws from its own
+ * stream, seeded from its index, so runs repeat, and -j, which splits
+ * the sets between threads, matches the serial run.
+ */
+static inline uint64_t nextRandom(uint64_t *state) {
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 0x2545f4914f6cdd1dULL;
+}
+
+/* point the PLRU tree bits of set away from way */
+static inline void plruTouch(cacheLevel *c, uint64_t setIndex, int way) {
+    uint64_t bits = c->plru[setIndex];
+    int node = 1, right;
+
+    for (int half = c->E >> 1; half > 0; half >>= 1) {
+        right = (way & half) != 0;
+        if (right)
+            bits &= ~(1ULL << node);
+        else
+            bits |= 1ULL << node;
+        node = 2 * node + right;
+    }
+    c->plru[setIndex] = bits;
+}
+
+/* update the state of policy pol for a hit on way */
+static inline void hitLine(int pol, cacheLevel *c, uint64_t setIndex, int way) {
+    cacheSet *set = &c->sets[setIndex];
+    cacheLine *ln = &c->lines[setIndex * c->Ep];
+
+    switch (pol) {
+        case LRU:
+            if (set->head != way) {
+                unlinkWay(set, ln, way);
+                pushFront(set, ln, way);
+            }
+            break;
+        case PLRU:
+            plruTouch(c, setIndex, way);
+            break;
+        case SRRIP:
+        case BRRIP:
+            c->meta[setIndex * c->Ep + way] = 0;
+            break;
+        case OPT:
+            c->meta[setIndex * c->Ep + way] = nextUse;
+            break;
+    }
+}
+
+/*
+ * The hierarchy. L1 is levels[0]; on a miss, a level fetches the line
+ * from the level below it, or from memory below the last. All levels
+ * allocate on writes. Below L1 the levels are
+ *
+ *     nine  (default) non-inclusive non-exclusive: a miss fills the
+ *           line in every level it missed in, and an eviction leaves
+ *           the levels above alone
+ *     incl  inclusive: as nine, but a line evicted from a level is
+ *           also invalidated in the levels above it (back-invalidation)
+ *     excl  exclusive: a line is in at most one level. A miss takes
+ *           the line out of the first lower level holding it and puts
+ *           it in L1 only; each level's victims go to the level below.
+ *
+ * With -w wb (default) a write marks the line dirty, and a dirty line
+ * is written to the level below, or to memory, when it is evicted.
+ * With -w wt every write is also passed to the level below. Either
+ * way, a level's writebacks count the lines it wrote downwards.
+ */
+int accessBelow(int i, uint64_t address, int write);
+void writeDown(int i, uint64_t address);
+int fillLine(int pol, int i, uint64_t address, int dirty);
+int takeLine(int pol, int i, uint64_t address);
+int streamHit(uint64_t address);
+void streamAllocate(uint64_t address);
+void prefetchAfter(uint64_t address, int ret);
+void prefetchReset(void);
+void prefetchFinish(void);
+
+/*
+ * accessLevel - read or write address in level i, where pol is the
+ *     policy, fetching it from below on a miss. Returns 0 for a hit, 1
+ *     for a miss, and 2 for a miss that evicted a line from level i.
+ *     Inlined into accessOp for L1, so a constant pol folds the
+ *     policy switch of the hit path away; the levels below go through
+ *     accessBelow.
+ */
+static inline __attribute__((always_inline))
+int accessLevel(int pol, int i, uint64_t address, int write) {
+    cacheLevel *c = &levels[i];
+    uint64_t setIndex = setOf(c, address);
+    cacheSet *set = &c->sets[setIndex];
+    int way, dirty = 0, ret = 0;
+
+    way = findWay(&c->tags[setIndex * c->Ep], set->fill, address >> (c->s + b));
+    if (way >= 0) {
+        hitLine(pol, c, setIndex, way);
+        if (write && writeBack)
+            c->dirty[setIndex * c->Ep + way] = 1;
+        if (i == 0 && prefetcher != PF_NONE) {
+            if ((pfTagHit = c->pf[setIndex * c->Ep + way])) {
+                c->pf[setIndex * c->Ep + way] = 0;
+                pfStats.useful++;
+            }
+        }
+        stats[i].hits++;
+    } else if (i == 0 && prefetcher == PF_STREAM && streamHit(address)) {
+        fillLine(pol, 0, address, write && writeBack);  /* from the buffer, a hit */
+        stats[0].hits++;
+    } else {
+        stats[i].misses++;
+        if (i + 1 < nlevels) {
+            if (inclusion == EXCLUSIVE)
+                dirty = takeLine(pol, i + 1, address);
+            else
+                accessBelow(i + 1, address, 0);
+        }
+        ret = fillLine(pol, i, address, dirty || (write && writeBack));
+        if (i == 0 && prefetcher == PF_STREAM)
+            streamAllocate(address);
+    }
+    if (write && !writeBack)
+        writeDown(i, address);
+    return ret;
+}
+
+/*
+ * accessOp - run one access of a trace through the hierarchy under
+ *     policy pol: op S stores, L loads and M loads, then stores to the
+ *     line that brought in. Returns as accessLevel for the access to
+ *     L1, or -1 for other ops, which do not touch the cache.
+ */
+static inline __attribute__((always_inline))
+int accessOp(int pol, char op, uint64_t address) {
+    int ret;
+
+    switch (op) {
+        case 'S':
+            ret = accessLevel(pol, 0, address, 1);
+            break;
+        case 'M':
+            ret = accessLevel(pol, 0, address, 1);   /* the load, and the store hits */
+            stats[0].hits++;
+            break;
+        case 'L':
+            ret = accessLevel(pol, 0, address, 0);
+            break;
+        default:
+            return -1;
+    }
+    if (prefetcher != PF_NONE)
+        prefetchAfter(address, ret);
+    return ret;
+}
+
+#endif /* CSIM_CORE_H */
@@ -0,0 +1,239 @@
+#!/usr//bin/python
+#
+# test-levels.py - Check ./csim's cache hierarchy (-l, -i, -w) and its
+#     deterministic replacement policies (-p lru, fifo, plru) against a
+#     small reference model, on random traces that keep the sets
+#     thrashing. Also checks that -p random and brrip give the same
+#     counts with -j as on one thread. Prints each failing configuration
+#     and exits with status 1 if there is one.
+#
+import subprocess;
+import random;
+import sys;
+import os;
+import optparse;
+
+#
+# Level - one level of the reference model. Each set keeps its ways in
+# position order, as csim does, and a recency list of positions, most
+# recent first; plru holds the tree bits of each set.
+#
+class Level:
+    def __init__(self, s, E, b):
+        self.s, self.E, self.b = s, E, b
+        self.tags = [[] for i in range(1 << s)]
+        self.dirty = [[] for i in range(1 << s)]
+        self.order = [[] for i in range(1 << s)]
+        self.plru = [0] * (1 << s)
+        self.hits = self.misses = self.evictions = self.writebacks = 0
+
+    def split(self, addr):
+        return (addr >> self.b) & ((1 << self.s) - 1), addr >> (self.s + self.b)
+
+    def touch(self, si, way):
+        node, half = 1, self.E >> 1
+        while half > 0:
+            right = (way & half) != 0
+            if right:
+                self.plru[si] &= ~(1 << node)
+            else:
+                self.plru[si] |= 1 << node
+            node = 2 * node + right
+            half >>= 1
+
+    def victim(self, pol, si):
+        if pol == "plru":
+            node = 1
+            while node < self.E:
+                node = 2 * node + ((self.plru[si] >> node) & 1)
+            return node - self.E
+        return self.order[si][-1]       # lru and fifo: the list tail
+
+#
+# Model - the hierarchy, following the rules in the comments of csim.c
+#
+class Model:
+    def __init__(self, geoms, b, pol, incl, wb):
+        self.L = [Level(s, E, b) for (s, E) in geoms]
+        self.pol, self.incl, self.wb = pol, incl, wb
+
+    def find(self, c, addr):
+        si, tag = c.split(addr)
+        if tag in c.tags[si]:
+            return si, c.tags[si].index(tag)
+        return si, -1
+
+    def insert(self, i, addr, dirty):
+        c = self.L[i]
+        si, tag = c.split(addr)
+        ev = None
+        if len(c.tags[si]) < c.E:
+            way = len(c.tags[si])
+            c.tags[si].append(tag)
+            c.dirty[si].append(dirty)
+        else:
+            way = c.victim(self.pol, si)
+            ev = (((c.tags[si][way] << c.s) | si) << c.b, c.dirty[si][way])
+            c.order[si].remove(way)
+            c.tags[si][way] = tag
+            c.dirty[si][way] = dirty
+        c.order[si].insert(0, way)
+        if self.pol == "plru":
+            c.touch(si, way)
+        return ev
+
+    def remove(self, i, addr):
+        c = self.L[i]
+        si, way = self.find(c, addr)
+        if way < 0:
+            return -1
+        d = c.dirty[si][way]
+        c.order[si].remove(way)
+        last = len(c.tags[si]) - 1
+        if way != last:
+            c.tags[si][way] = c.tags[si][last]
+            c.dirty[si][way] = c.dirty[si][last]
+            c.order[si][c.order[si].index(last)] = way
+            if self.pol == "plru":
+                c.plru[si] = 0
+                for w in reversed(c.order[si]):
+                    c.touch(si, w)
+        c.tags[si].pop()
+        c.dirty[si].pop()
+        return d
+
+    def writeDown(self, i, addr):
+        self.L[i].writebacks += 1
+        if i + 1 < len(self.L):
+            self.access(i + 1, addr, 1)
+
+    def evict(self, i, addr, dirty):
+        self.L[i].evictions += 1
+        if self.incl == "incl":
+            for j in range(i):
+                if self.remove(j, addr) > 0:
+                    dirty = 1
+        if self.incl == "excl" and i + 1 < len(self.L):
+            if dirty:
+                self.L[i].writebacks += 1
+            self.fill(i + 1, addr, dirty)
+        elif dirty:
+            self.writeDown(i, addr)
+
+    def fill(self, i, addr, dirty):
+        ev = self.insert(i, addr, dirty)
+        if ev is not None:
+            self.evict(i, ev[0], ev[1])
+
+    def take(self, i, addr):
+        for j in range(i, len(self.L)):
+            d = self.remove(j, addr)
+            if d >= 0:
+                self.L[j].hits += 1
+                return d
+            self.L[j].misses += 1
+        return 0
+
+    def access(self, i, addr, write):
+        c = self.L[i]
+        si, way = self.find(c, addr)
+        dirty = 0
+        if way >= 0:
+            if self.pol == "lru":
+                c.order[si].remove(way)
+                c.order[si].insert(0, way)
+            elif self.pol == "plru":
+                c.touch(si, way)
+            if write and self.wb:
+                c.dirty[si][way] = 1
+            c.hits += 1
+        else:
+            c.misses += 1
+            if i + 1 < len(self.L):
+                if self.incl == "excl":
+                    dirty = self.take(i + 1, addr)
+                else:
+                    self.access(i + 1, addr, 0)
+            self.fill(i, addr, 1 if dirty or (write and self.wb) else 0)
+        if write and not self.wb:
+            self.writeDown(i, addr)
+
+    def run(self, trace):
+        for (op, addr) in trace:
+            self.access(0, addr, 0 if op == "L" else 1)
+            if op == "M":
+                self.L[0].hits += 1
+        return ["L%d hits:%d misses:%d evictions:%d writebacks:%d"
+                % (i + 1, c.hits, c.misses, c.evictions, c.writebacks)
+                for (i, c) in enumerate(self.L)]
+
+#
+# csimLevels - the L<n> lines ./csim prints for a configuration
+#
+def csimLevels(geoms, b, pol, incl, wb, path):
+    cmd = ["./csim", "-s", str(geoms[0][0]), "-E", str(geoms[0][1]),
+           "-b", str(b), "-p", pol, "-i", incl, "-w", "wb" if wb else "wt",
+           "-t", path]
+    for (s, E) in geoms[1:]:
+        cmd += ["-l", "%d,%d" % (s, E)]
+    out = subprocess.Popen(cmd, stdout=subprocess.PIPE).communicate()[0]
+    return [l for l in out.decode().split("\n") if l.startswith("L")]
+
+#
+# csimSummary - the summary line of ./csim with extra arguments
+#
+def csimSummary(args, path):
+    out = subprocess.Popen(["./csim"] + args + ["-t", path],
+                           stdout=subprocess.PIPE).communicate()[0]
+    return out.decode().strip()
+
+#
+# main - Main function
+#
+def main():
+    p = optparse.OptionParser()
+    p.add_option("-n", dest="traces", type="int", default=20,
+                 help="random traces per configuration")
+    p.add_option("-S", dest="seed", type="int", default=1, help="random seed")
+    opts, args = p.parse_args()
+    random.seed(opts.seed)
+
+    b = 4
+    hierarchies = [[(1, 2), (2, 4)], [(0, 4), (1, 4), (2, 4)], [(1, 1), (1, 2)]]
+    path = ".test-levels.trace"
+    failed = 0
+    for n in range(opts.traces):
+        blocks = random.randint(8, 48)
+        trace = [(random.choice("LSM"), random.randrange(blocks) << b)
+                 for i in range(2000)]
+        f = open(path, "w")
+        for (op, addr) in trace:
+            f.write(" %s %x,4\n" % (op, addr))
+        f.close()
+        for geoms in hierarchies:
+            for pol in ["lru", "fifo", "plru"]:
+                for incl in ["nine", "incl", "excl"]:
+                    for wb in [1, 0]:
+                        if incl == "excl" and not wb:
+                            continue    # csim needs -w wb with -i excl
+                        want = Model(geoms, b, pol, incl, wb).run(trace)
+                        got = csimLevels(geoms, b, pol, incl, wb, path)
+                        if got != want:
+                            failed += 1
+                            print("FAIL levels %s -p %s -i %s -w %s, trace %d"
+                                  % (geoms, pol, incl, "wb" if wb else "wt", n))
+                            print("  expected %s\n  got      %s" % (want, got))
+        for pol in ["random", "brrip"]:
+            geom = ["-s", "3", "-E", "2", "-b", str(b), "-p", pol]
+            serial = csimSummary(geom, path)
+            for j in ["2", "3", "8"]:
+                if csimSummary(geom + ["-j", j], path) != serial:
+                    failed += 1
+                    print("FAIL -p %s -j %s differs from one thread, trace %d"
+                          % (pol, j, n))
+    os.remove(path)
+    print("%s: %d failures" % ("FAIL" if failed else "OK", failed))
+    sys.exit(1 if failed else 0)
+
+if __name__ == "__main__":
+    main()
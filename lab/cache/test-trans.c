@@ -12,6 +12,7 @@
 #include <getopt.h>
 #include <sys/types.h>
 #include "cachelab.h"
+#include "csim_core.h"
 #include <sys/wait.h> // fir WEXITSTATUS
 #include <limits.h> // for INT_MAX
 
@@ -41,23 +42,271 @@ struct results {
 };
 static struct results results = {-1, 0, INT_MAX};
 
-/* 
- * eval_perf - Evaluate the performance of the registered transpose functions
+/* Both matrices, laid out as in tracegen: B right after A, aligned to a block */
+static int matrices[2][MAXN][MAXN] __attribute__((aligned(64)));
+
+/* Set by -V: trace with valgrind and simulate with csim-ref */
+static int use_valgrind = 0;
+
+/* One access recorded by recordAccess */
+typedef struct {
+    unsigned long addr;
+    int size;
+    char op;
+} access_t;
+
+/* The accesses of the function being traced, in program order */
+static access_t *accesses = NULL;
+static size_t num_accesses = 0, max_accesses = 0;
+
+/*
+ * recordAccess - Record one access made through LOAD or STORE. trans.c
+ *     is compiled with -DTRACE_ACCESSES for test-trans, so this is
+ *     called for exactly the A and B accesses of the transpose functions.
  */
-void eval_perf(unsigned int s, unsigned int E, unsigned int b)
+void recordAccess(const void *addr, int size, char op)
+{
+    if (num_accesses == max_accesses) {
+        max_accesses = max_accesses ? 2 * max_accesses : 65536;
+        accesses = realloc(accesses, max_accesses * sizeof(access_t));
+        assert(accesses);
+    }
+    accesses[num_accesses].addr = (unsigned long) addr;
+    accesses[num_accesses].size = size;
+    accesses[num_accesses].op = op;
+    num_accesses++;
+}
+
+/*
+ * validate - Check that B is the transpose of A, as tracegen does
+ */
+int validate(int fn, int M, int N, int A[N][M], int B[M][N])
+{
+    int i, j;
+    int (*C)[N] = malloc(sizeof(int) * M * N);
+
+    assert(C);
+    correctTrans(M, N, A, C);
+    for (i = 0; i < M; i++) {
+        for (j = 0; j < N; j++) {
+            if (B[i][j] != C[i][j]) {
+                printf("Validation failed on function %d! Expected %d but got %d at B[%d][%d]\n",
+                       fn, C[i][j], B[i][j], i, j);
+                free(C);
+                return 0;
+            }
+        }
+    }
+    free(C);
+    return 1;
+}
+
+/*
+ * check_coverage - Check that the recorded trace loads every element of
+ *     A and stores every element of B. A function that reads or writes
+ *     them without LOAD and STORE would otherwise be charged no misses
+ *     for those accesses. Returns 1 if the trace is complete, or 0.
+ */
+int check_coverage(int i)
+{
+    static char loaded[MAXN * MAXN], stored[MAXN * MAXN];
+    unsigned long a0 = (unsigned long) matrices[0];
+    unsigned long b0 = (unsigned long) matrices[1];
+    unsigned long end = (unsigned long) M * N * sizeof(int);
+    int k, missing_a = 0, missing_b = 0;
+    size_t j;
+
+    memset(loaded, 0, M * N);
+    memset(stored, 0, M * N);
+    for (j = 0; j < num_accesses; j++) {
+        if (accesses[j].op == 'L' && accesses[j].addr - a0 < end)
+            loaded[(accesses[j].addr - a0) / sizeof(int)] = 1;
+        else if (accesses[j].op == 'S' && accesses[j].addr - b0 < end)
+            stored[(accesses[j].addr - b0) / sizeof(int)] = 1;
+    }
+    for (k = 0; k < M * N; k++) {
+        missing_a += !loaded[k];
+        missing_b += !stored[k];
+    }
+    if (missing_a || missing_b) {
+        printf("Function %d did not LOAD %d elements of A and did not STORE %d elements of B.\n"
+               "Access A and B only through LOAD and STORE, or measure it with -V.\n",
+               i, missing_a, missing_b);
+        return 0;
+    }
+    return 1;
+}
+
+/*
+ * trace_native - Run function i in this process, recording its accesses
+ *     in the accesses buffer, and save them to trace.f<i>. Returns 1 if
+ *     it transposed correctly and every access to A and B was recorded,
+ *     or 0.
+ */
+int trace_native(int i)
+{
+    int (*A)[M] = (int (*)[M]) matrices[0];
+    int (*B)[N] = (int (*)[N]) matrices[1];
+    char filename[128];
+    FILE* part_trace_fp;
+    size_t k;
+
+    initMatrix(M, N, A, B);
+    num_accesses = 0;
+    (*func_list[i].func_ptr)(M, N, A, B);
+    if (!validate(i, M, N, A, B)) {
+        printf("Validation error at function %d!\nSkipping performance evaluation for this function.\n", i);
+        return 0;
+    }
+    if (!check_coverage(i)) {
+        printf("Trace error at function %d!\nSkipping performance evaluation for this function.\n", i);
+        return 0;
+    }
+
+    /* Save the trace in lackey's format, so csim can replay it */
+    sprintf(filename, "trace.f%d", i);
+    part_trace_fp = fopen(filename, "w");
+    assert(part_trace_fp);
+    for (k = 0; k < num_accesses; k++)
+        fprintf(part_trace_fp, " %c %08lx,%d\n", accesses[k].op,
+                accesses[k].addr, accesses[k].size);
+    fclose(part_trace_fp);
+    return 1;
+}
+
+/*
+ * simulate - Run the recorded accesses through csim's engine, as an
+ *     LRU cache with 2^s sets of E lines of 2^b bytes
+ */
+void simulate(unsigned int s, unsigned int E, unsigned int bits,
+              unsigned int *hits, unsigned int *misses, unsigned int *evictions)
+{
+    size_t k;
+
+    b = bits;
+    nlevels = 1;
+    levelS[0] = s;
+    levelE[0] = E;
+    policy = LRU;
+    memset(stats, 0, sizeof(stats));
+    initCache();
+    for (k = 0; k < num_accesses; k++)
+        cacheAccess(accesses[k].op, accesses[k].addr);
+    freeCache();
+    *hits = stats[0].hits;
+    *misses = stats[0].misses;
+    *evictions = stats[0].evictions;
+}
+
+/*
+ * trace_valgrind - Generate the trace of function i by running tracegen
+ *     under valgrind's lackey tool and cutting out the accesses between
+ *     the markers into trace.f<i>. Returns 1 if it transposed correctly,
+ *     or 0.
+ */
+int trace_valgrind(int i)
 {
-    int i,flag;
-    unsigned int len, hits, misses, evictions;
+    int flag;
+    unsigned int len;
     unsigned long long int marker_start, marker_end, addr;
     char buf[1000], cmd[255];
     char filename[128];
 
-    registerFunctions(); 
-
     /* Open the complete trace file */
     FILE* full_trace_fp;  
     FILE* part_trace_fp; 
 
+    /* Use valgrind to generate the trace */
+    sprintf(cmd, "valgrind --tool=lackey --trace-mem=yes --log-fd=1 -v ./tracegen -M %d -N %d -F %d  > trace.tmp", M, N,i);
+    flag=WEXITSTATUS(system(cmd));
+    if (0!=flag) {
+        printf("Validation error at function %d! Run ./tracegen -M %d -N %d -F %d for details.\nSkipping performance evaluation for this function.\n",flag-1,M,N,i);      
+        return 0;
+    }
+
+    /* Get the start and end marker addresses */
+    FILE* marker_fp = fopen(".marker", "r");
+    assert(marker_fp);
+    fscanf(marker_fp, "%llx %llx", &marker_start, &marker_end);
+    fclose(marker_fp);
+
+    full_trace_fp = fopen("trace.tmp", "r");
+    assert(full_trace_fp);
+
+
+    /* Filtered trace for each transpose function goes in a separate file */
+    sprintf(filename, "trace.f%d", i);
+    part_trace_fp = fopen(filename, "w");
+    assert(part_trace_fp);
+    
+    /* Locate trace corresponding to the trans function */
+    flag = 0;
+    while (fgets(buf, 1000, full_trace_fp) != NULL) {
+
+        /* We are only interested in memory access instructions */
+        if (buf[0]==' ' && buf[2]==' ' &&
+            (buf[1]=='S' || buf[1]=='M' || buf[1]=='L' )) {
+            sscanf(buf+3, "%llx,%u", &addr, &len);
+        
+            /* If start marker found, set flag */
+            if (addr == marker_start)
+                flag = 1;
+
+            /* Valgrind creates many spurious accesses to the
+               stack that have nothing to do with the students
+               code. At the moment, we are ignoring all stack
+               accesses by using the simple filter of recording
+               accesses to only the low 32-bit portion of the
+               address space. At some point it would be nice to
+               try to do more informed filtering so that would
+               eliminate the valgrind stack references while
+               include the student stack references. */
+            if (flag && addr < 0xffffffff) {
+                fputs(buf, part_trace_fp);
+            }
+
+            /* if end marker found, close trace file */
+            if (addr == marker_end) {
+                flag = 0;
+                fclose(part_trace_fp);
+                break;
+            }
+        }
+    }
+    fclose(full_trace_fp);
+    return 1;
+}
+
+/*
+ * simulate_valgrind - Run the reference simulator on trace.f<i>
+ */
+void simulate_valgrind(int i, unsigned int s, unsigned int E, unsigned int b,
+                       unsigned int *hits, unsigned int *misses,
+                       unsigned int *evictions)
+{
+    char cmd[255];
+
+    sprintf(cmd, "./csim-ref -s %u -E %u -b %u -t trace.f%d > /dev/null", 
+            s, E, b, i);
+    system(cmd);
+    
+    /* Collect results from the reference simulator */
+    FILE* in_fp = fopen(".csim_results","r");
+    assert(in_fp);
+    fscanf(in_fp, "%u %u %u", hits, misses, evictions);
+    fclose(in_fp);
+}
+
+/* 
+ * eval_perf - Evaluate the performance of the registered transpose functions
+ */
+void eval_perf(unsigned int s, unsigned int E, unsigned int b)
+{
+    int i;
+    unsigned int hits, misses, evictions;
+
+    registerFunctions(); 
+
     /* Evaluate the performance of each registered transpose function */
 
     for (i=0; i<func_counter; i++) {
@@ -66,21 +315,8 @@ void eval_perf(unsigned int s, unsigned int E, unsigned int b)
 
 
         printf("\nFunction %d (%d total)\nStep 1: Validating and generating memory traces\n",i,func_counter);
-        /* Use valgrind to generate the trace */
-
-        sprintf(cmd, "valgrind --tool=lackey --trace-mem=yes --log-fd=1 -v ./tracegen -M %d -N %d -F %d  > trace.tmp", M, N,i);
-        flag=WEXITSTATUS(system(cmd));
-        if (0!=flag) {
-            printf("Validation error at function %d! Run ./tracegen -M %d -N %d -F %d for details.\nSkipping performance evaluation for this function.\n",flag-1,M,N,i);      
+        if (use_valgrind ? !trace_valgrind(i) : !trace_native(i))
             continue;
-        }
-
-        /* Get the start and end marker addresses */
-        FILE* marker_fp = fopen(".marker", "r");
-        assert(marker_fp);
-        fscanf(marker_fp, "%llx %llx", &marker_start, &marker_end);
-        fclose(marker_fp);
-
 
         func_list[i].correct=1;
 
@@ -89,63 +325,11 @@ void eval_perf(unsigned int s, unsigned int E, unsigned int b)
             results.correct = 1;
         }
 
-        full_trace_fp = fopen("trace.tmp", "r");
-        assert(full_trace_fp);
-
-
-        /* Filtered trace for each transpose function goes in a separate file */
-        sprintf(filename, "trace.f%d", i);
-        part_trace_fp = fopen(filename, "w");
-        assert(part_trace_fp);
-    
-        /* Locate trace corresponding to the trans function */
-        flag = 0;
-        while (fgets(buf, 1000, full_trace_fp) != NULL) {
-
-            /* We are only interested in memory access instructions */
-            if (buf[0]==' ' && buf[2]==' ' &&
-                (buf[1]=='S' || buf[1]=='M' || buf[1]=='L' )) {
-                sscanf(buf+3, "%llx,%u", &addr, &len);
-        
-                /* If start marker found, set flag */
-                if (addr == marker_start)
-                    flag = 1;
-
-                /* Valgrind creates many spurious accesses to the
-                   stack that have nothing to do with the students
-                   code. At the moment, we are ignoring all stack
-                   accesses by using the simple filter of recording
-                   accesses to only the low 32-bit portion of the
-                   address space. At some point it would be nice to
-                   try to do more informed filtering so that would
-                   eliminate the valgrind stack references while
-                   include the student stack references. */
-                if (flag && addr < 0xffffffff) {
-                    fputs(buf, part_trace_fp);
-                }
-
-                /* if end marker found, close trace file */
-                if (addr == marker_end) {
-                    flag = 0;
-                    fclose(part_trace_fp);
-                    break;
-                }
-            }
-        }
-        fclose(full_trace_fp);
-
-        /* Run the reference simulator */
         printf("Step 2: Evaluating performance (s=%d, E=%d, b=%d)\n", s, E, b);
-        char cmd[255];
-        sprintf(cmd, "./csim-ref -s %u -E %u -b %u -t trace.f%d > /dev/null", 
-                s, E, b, i);
-        system(cmd);
-    
-        /* Collect results from the reference simulator */
-        FILE* in_fp = fopen(".csim_results","r");
-        assert(in_fp);
-        fscanf(in_fp, "%u %u %u", &hits, &misses, &evictions);
-        fclose(in_fp);
+        if (use_valgrind)
+            simulate_valgrind(i, s, E, b, &hits, &misses, &evictions);
+        else
+            simulate(s, E, b, &hits, &misses, &evictions);
         func_list[i].num_hits = hits;
         func_list[i].num_misses = misses;
         func_list[i].num_evictions = evictions;
@@ -164,9 +348,10 @@ void eval_perf(unsigned int s, unsigned int E, unsigned int b)
  * usage - Print usage info
  */
 void usage(char *argv[]){
-    printf("Usage: %s [-h] -M <rows> -N <cols>\n", argv[0]);
+    printf("Usage: %s [-hV] -M <rows> -N <cols>\n", argv[0]);
     printf("Options:\n");
     printf("  -h          Print this help message.\n");
+    printf("  -V          Trace with valgrind and simulate with csim-ref.\n");
     printf("  -M <rows>   Number of matrix rows (max %d)\n", MAXN);
     printf("  -N <cols>   Number of  matrix columns (max %d)\n", MAXN);
     printf("Example: %s -M 8 -N 8\n", argv[0]);       
@@ -199,7 +384,7 @@ int main(int argc, char* argv[])
 {
     char c;
 
-    while ((c = getopt(argc,argv,"M:N:h")) != -1) {
+    while ((c = getopt(argc,argv,"M:N:hV")) != -1) {
         switch(c) {
         case 'M':
             M = atoi(optarg);
@@ -210,6 +395,9 @@ int main(int argc, char* argv[])
         case 'h':
             usage(argv);
             exit(0);
+        case 'V':
+            use_valgrind = 1;
+            break;
         default:
             usage(argv);
             exit(1);
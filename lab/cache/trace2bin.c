@@ -0,0 +1,68 @@
+/*
+ * trace2bin.c - Convert a text memory trace into the binary trace
+ *     format described in tracefmt.h. csim reads either format.
+ *
+ * usage: trace2bin <in.trace> <out.bin>
+ */
+#define _POSIX_C_SOURCE 200809L /* getline */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "tracefmt.h"
+
+int main(int argc, char **argv) {
+    FILE *fp;
+    traceWriter *w;
+    char *line = NULL, op;
+    const char *p;
+    size_t cap = 0;
+    ssize_t len;
+    uint64_t address;
+    int size, ret;
+    unsigned long lineno = 0;
+
+    if (argc != 3) {
+        fprintf(stderr, "usage: %s <in.trace> <out.bin>\n", argv[0]);
+        exit(1);
+    }
+    if ((fp = fopen(argv[1], "r")) == NULL) {
+        perror(argv[1]);
+        exit(1);
+    }
+    if ((w = openTraceWriter(argv[2])) == NULL) {
+        perror(argv[2]);
+        exit(1);
+    }
+
+    /* the same rules as csim's reader, one line at a time */
+    while ((len = getline(&line, &cap, fp)) > 0) {
+        lineno++;
+        p = line;
+        if ((ret = parseTraceLine(&p, line + len, &op, &address, &size)) < 0) {
+            fprintf(stderr, "%s:%lu: malformed trace line: %s%s", argv[1],
+                    lineno, line, line[len - 1] == '\n' ? "" : "\n");
+            exit(1);
+        }
+        if (ret == 0)
+            continue;  /* blank line */
+        if (size > TRACE_MAX_SIZE) {
+            fprintf(stderr, "%s:%lu: access size %d is over %d\n",
+                    argv[1], lineno, size, TRACE_MAX_SIZE);
+            exit(1);
+        }
+        if (writeTraceRecord(w, traceOpCode(op), address, size) < 0) {
+            perror(argv[2]);
+            exit(1);
+        }
+    }
+    free(line);
+    fclose(fp);
+
+    if (closeTraceWriter(w) < 0) {
+        perror(argv[2]);
+        exit(1);
+    }
+    return 0;
+}
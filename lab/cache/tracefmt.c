@@ -0,0 +1,126 @@
+/*
+ * tracefmt.c - Writer for the binary memory trace format (tracefmt.h)
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "tracefmt.h"
+
+/* function prototypes */
+static int flushBlock(traceWriter *w);
+
+/*
+ * traceOpCode - the TRACE_ op for op character op, or -1
+ */
+int traceOpCode(char op) {
+    switch (op) {
+        case 'I': return TRACE_I;
+        case 'L': return TRACE_L;
+        case 'S': return TRACE_S;
+        case 'M': return TRACE_M;
+        default:  return -1;
+    }
+}
+
+/*
+ * openTraceWriter - create path and write a placeholder header, which
+ *     closeTraceWriter fills in once the counts are known
+ */
+traceWriter *openTraceWriter(const char *path) {
+    traceWriter *w = malloc(sizeof(traceWriter));
+
+    if (w == NULL)
+        return NULL;
+    memset(&w->hdr, 0, sizeof(w->hdr));
+    w->hdr.magic = TRACE_MAGIC;
+    w->hdr.version = TRACE_VERSION;
+    w->hdr.block_records = TRACE_BLOCK_RECORDS;
+    memset(&w->regs, 0, sizeof(w->regs));
+    w->records = w->len = 0;
+    if ((w->fp = fopen(path, "wb")) == NULL) {
+        free(w);
+        return NULL;
+    }
+    if (fwrite(&w->hdr, sizeof(w->hdr), 1, w->fp) != 1) {
+        fclose(w->fp);
+        free(w);
+        return NULL;
+    }
+    return w;
+}
+
+/*
+ * writeTraceRecord - encode one access into the current block against
+ *     the closest delta register, and flush the block once it is full
+ */
+int writeTraceRecord(traceWriter *w, int op, uint64_t address, int size) {
+    unsigned char *p = w->buf + w->len;
+    uint64_t d, zz, best = UINT64_MAX;
+    int i, r = 0;
+
+    if (op < TRACE_I || op > TRACE_M || size < 0 || size > TRACE_MAX_SIZE)
+        return -1;
+
+    /* the smallest zigzag delta is the shortest varint */
+    for (i = 0; i < TRACE_REGS; i++) {
+        d = address - w->regs.reg[i];
+        zz = (d << 1) ^ -(d >> 63);
+        if (zz < best) {
+            best = zz;
+            r = i;
+        }
+    }
+    for (i = r; i > 0; i--)
+        w->regs.reg[i] = w->regs.reg[i - 1];
+    w->regs.reg[0] = address;
+
+    *p++ = (unsigned char) (op << 6 | r << 4 | (size < 16 ? size : 0));
+    while (best >= 0x80) {
+        *p++ = (unsigned char) (best | 0x80);
+        best >>= 7;
+    }
+    *p++ = (unsigned char) best;
+    if (size == 0 || size >= 16)
+        *p++ = (unsigned char) size;
+
+    w->len = (uint32_t) (p - w->buf);
+    w->hdr.num_records++;
+    if (++w->records == TRACE_BLOCK_RECORDS)
+        return flushBlock(w);
+    return 0;
+}
+
+/*
+ * closeTraceWriter - write the last block and the real header
+ */
+int closeTraceWriter(traceWriter *w) {
+    int ret = 0;
+
+    if (w->records > 0 && flushBlock(w) < 0)
+        ret = -1;
+    if (ret == 0 && (fseek(w->fp, 0, SEEK_SET) < 0 ||
+                     fwrite(&w->hdr, sizeof(w->hdr), 1, w->fp) != 1))
+        ret = -1;
+    if (fclose(w->fp) != 0)
+        ret = -1;
+    free(w);
+    return ret;
+}
+
+/*
+ * flushBlock - write the current block and start a new one with
+ *     cleared delta registers
+ */
+static int flushBlock(traceWriter *w) {
+    traceBlockHdr bh;
+
+    bh.records = w->records;
+    bh.bytes = w->len;
+    if (fwrite(&bh, sizeof(bh), 1, w->fp) != 1 ||
+        fwrite(w->buf, 1, w->len, w->fp) != w->len)
+        return -1;
+    w->hdr.num_blocks++;
+    w->records = w->len = 0;
+    memset(&w->regs, 0, sizeof(w->regs));
+    return 0;
+}
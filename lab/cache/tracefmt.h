@@ -0,0 +1,184 @@
+/*
+ * tracefmt.h - Binary memory trace format read by csim
+ *
+ * A binary trace is a traceHdr, followed by num_blocks blocks. Each
+ * block is a traceBlockHdr and then up to TRACE_BLOCK_RECORDS records
+ * packed into bytes bytes. A record is
+ *
+ *     op byte    op in bits 7-6 (TRACE_I, _L, _S or _M), delta
+ *                register in bits 5-4, and the access size in bits 3-0,
+ *                or 0 if a size byte follows
+ *     delta      the address minus the delta register, zigzag-encoded
+ *                as a LEB128 varint
+ *     size byte  only if bits 3-0 of the op byte are 0
+ *
+ * Encoder and decoder keep the last TRACE_REGS addresses in the delta
+ * registers, most recently used first. Each record names the register
+ * its address is closest to, and that register then moves to the front
+ * holding the new address. Programs interleave a few streams (stack,
+ * source, destination), so most deltas fit in one byte, and a typical
+ * record takes 2 or 3 bytes where a lackey line takes 14 to 16. The
+ * registers are cleared at the start of each block, so every block
+ * decodes on its own. The records are bytes and varints, but traceHdr
+ * and traceBlockHdr are written in the byte order of the host, so a
+ * trace only reads back on hosts of the same endianness; elsewhere its
+ * magic does not match and csim takes it for a text trace.
+ */
+#ifndef TRACEFMT_H
+#define TRACEFMT_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#define TRACE_MAGIC   0x43525443  /* "CTRC" */
+#define TRACE_VERSION 1
+
+#define TRACE_I 0
+#define TRACE_L 1
+#define TRACE_S 2
+#define TRACE_M 3
+
+#define TRACE_REGS 4              /* delta registers */
+#define TRACE_BLOCK_RECORDS 4096  /* most records in a block */
+#define TRACE_MAX_RECORD 12       /* op byte, 10-byte varint, size byte */
+#define TRACE_MAX_SIZE 255        /* largest size a record can hold */
+
+typedef struct {
+    uint32_t magic;          /* TRACE_MAGIC */
+    uint32_t version;        /* TRACE_VERSION */
+    uint64_t num_records;    /* records in all blocks */
+    uint32_t num_blocks;
+    uint32_t block_records;  /* TRACE_BLOCK_RECORDS when written */
+} traceHdr;
+
+typedef struct {
+    uint32_t records;        /* records in this block */
+    uint32_t bytes;          /* bytes of records after this header */
+} traceBlockHdr;
+
+/* The delta registers, most recently used first */
+typedef struct {
+    uint64_t reg[TRACE_REGS];
+} traceRegs;
+
+/* Buffers a block of records at a time for writeTraceRecord */
+typedef struct {
+    FILE *fp;
+    traceHdr hdr;
+    traceRegs regs;
+    uint32_t records;        /* records in the current block */
+    uint32_t len;            /* bytes in the current block */
+    unsigned char buf[TRACE_BLOCK_RECORDS * TRACE_MAX_RECORD];
+} traceWriter;
+
+/* op character (I, L, S or M) of a TRACE_ op, and the reverse (-1 if none) */
+#define TRACE_OP_CHAR(op) ("ILSM"[op])
+int traceOpCode(char op);
+
+/* Create path and return a writer for it, or NULL */
+traceWriter *openTraceWriter(const char *path);
+
+/* Append one access; returns 0, or -1 on an error or a bad size */
+int writeTraceRecord(traceWriter *w, int op, uint64_t address, int size);
+
+/* Flush the last block, fill in the header and close; returns 0 or -1 */
+int closeTraceWriter(traceWriter *w);
+
+/*
+ * decodeRecord - decode the record at p, which must end by end, using
+ *     and updating the delta registers r. Returns the first byte after
+ *     the record, or NULL if it runs past end. Inline, since csim calls
+ *     it once per access.
+ */
+static inline const unsigned char *decodeRecord(traceRegs *r,
+        const unsigned char *p, const unsigned char *end,
+        int *op, uint64_t *address, int *size) {
+    uint64_t zz = 0, addr;
+    int shift = 0, i, c;
+
+    if (p == end)
+        return NULL;
+    c = *p++;
+    do {
+        if (p == end || shift > 63)
+            return NULL;
+        zz |= (uint64_t) (*p & 0x7f) << shift;
+        shift += 7;
+    } while (*p++ & 0x80);
+    if ((*size = c & 0xf) == 0) {
+        if (p == end)
+            return NULL;
+        *size = *p++;
+    }
+
+    i = c >> 4 & (TRACE_REGS - 1);
+    addr = r->reg[i] + ((zz >> 1) ^ -(zz & 1));
+    for (; i > 0; i--)
+        r->reg[i] = r->reg[i - 1];
+    r->reg[0] = addr;
+    *op = c >> 6;
+    *address = addr;
+    return p;
+}
+
+/* true for the blanks allowed around the fields of a trace line */
+#define TRACE_IS_BLANK(c) ((c) == ' ' || (c) == '\t' || (c) == '\r')
+
+/*
+ * parseTraceLine - parse the text trace line at *pp, which has the form
+ *     "[blanks]op blanks addr,size[blanks]" with op one of I, L, S or M,
+ *     addr in hex (at most 16 digits) and size in decimal, and ends at
+ *     a newline or at end. The line is scanned once, without finding
+ *     its end first. Returns 1 and fills in *op, *address and *sz; 0
+ *     for a blank line; or -1 if the line is malformed. On success *pp
+ *     is moved past the newline. Inline, since csim calls it once per
+ *     line; trace2bin uses it too, so both accept the same lines.
+ */
+static inline int parseTraceLine(const char **pp, const char *end, char *op,
+                                 uint64_t *address, int *sz) {
+    const char *p = *pp;
+    uint64_t addr = 0;
+    long size = 0;
+    int digits, d, ret = 1;
+
+    while (p < end && TRACE_IS_BLANK(*p)) p++;
+    if (p == end || *p == '\n') {
+        ret = 0;
+        goto eol;
+    }
+    if (*p != 'I' && *p != 'L' && *p != 'S' && *p != 'M')
+        return -1;
+    *op = *p++;
+    if (p == end || !TRACE_IS_BLANK(*p))
+        return -1;
+    while (p < end && TRACE_IS_BLANK(*p)) p++;
+
+    for (digits = 0; p < end; p++, digits++) {
+        if ((unsigned) (*p - '0') < 10)
+            d = *p - '0';
+        else if ((unsigned) ((*p | 0x20) - 'a') < 6)
+            d = (*p | 0x20) - 'a' + 10;
+        else
+            break;
+        addr = addr << 4 | d;
+    }
+    if (digits == 0 || digits > 16 || p == end || *p++ != ',')
+        return -1;
+
+    for (digits = 0; p < end && (unsigned) (*p - '0') < 10; p++, digits++)
+        if ((size = size * 10 + (*p - '0')) > INT32_MAX)
+            return -1;
+    if (digits == 0)
+        return -1;
+    while (p < end && TRACE_IS_BLANK(*p)) p++;
+    *address = addr;
+    *sz = (int) size;
+
+eol:
+    if (p < end && *p++ != '\n')
+        return -1;
+    *pp = p;
+    return ret;
+}
+
+#endif /* TRACEFMT_H */
@@ -6,6 +6,13 @@
  *
  * A transpose function is evaluated by counting the number of misses
  * on a 1KB direct mapped cache with a block size of 32 bytes.
+ *
+ * Read A and B only through LOAD(x) and write them only through
+ * STORE(x, v) (see cachelab.h). test-trans counts exactly the accesses
+ * made through these macros. It rejects a function whose trace does not
+ * load every element of A and store every element of B, since some of
+ * its accesses then bypassed the macros. Use test-trans -V to measure
+ * such a function under valgrind.
  */
 #include <stdio.h>
 #include <assert.h>
@@ -16,291 +23,291 @@ void trans_normal(int s, int ii, int jj, int r, int c, int M, int N, int A[N][M]
     int i, j;
     for (i = 0; i < ii; i++) {
         for (j = 0; j < jj; j++) {
-            B[c * s + j][r * s + i] = A[r * s + i][c * s + j];
+            STORE(B[c * s + j][r * s + i], LOAD(A[r * s + i][c * s + j]));
         }
     }
 }
 
 void trans_square2(int r, int c, int N, int A[N][N], int B[N][N]) {
     int t0, t1, t2, t3;
-    t0 = A[r][c];
-    t1 = A[r][c + 1];
-    t2 = A[r + 1][c];
-    t3 = A[r + 1][c + 1];
-    B[c][r] = t0;
-    B[c][r + 1] = t2;
-    B[c + 1][r] = t1;
-    B[c + 1][r + 1] = t3;
+    t0 = LOAD(A[r][c]);
+    t1 = LOAD(A[r][c + 1]);
+    t2 = LOAD(A[r + 1][c]);
+    t3 = LOAD(A[r + 1][c + 1]);
+    STORE(B[c][r], t0);
+    STORE(B[c][r + 1], t2);
+    STORE(B[c + 1][r], t1);
+    STORE(B[c + 1][r + 1], t3);
 }
 
 void trans_square4_v2(int r, int c, int N, int A[N][N], int B[N][N]) {
     int t0, t1, t2, t3, t4, t5, t6, t7;
-    t0 = A[r + 0][c + 0];
-    t1 = A[r + 0][c + 1];
-    t2 = A[r + 1][c + 0];
-    t3 = A[r + 1][c + 1];
-    t4 = A[r + 2][c + 0];
-    t5 = A[r + 2][c + 1];
-    t6 = A[r + 3][c + 0];
-    t7 = A[r + 3][c + 1];
-    B[c + 0][r + 0] = t0;
-    B[c + 0][r + 1] = t2;
-    B[c + 0][r + 2] = t4;
-    B[c + 0][r + 3] = t6;
-    B[c + 1][r + 0] = t1;
-    B[c + 1][r + 1] = t3;
-    B[c + 1][r + 2] = t5;
-    B[c + 1][r + 3] = t7;
-
-
-    t0 = A[r + 0][c + 2];
-    t1 = A[r + 0][c + 3];
-    t2 = A[r + 1][c + 2];
-    t3 = A[r + 1][c + 3];
-    t4 = A[r + 2][c + 2];
-    t5 = A[r + 2][c + 3];
-    t6 = A[r + 3][c + 2];
-    t7 = A[r + 3][c + 3];
-    B[c + 2][r + 0] = t0;
-    B[c + 2][r + 1] = t2;
-    B[c + 2][r + 2] = t4;
-    B[c + 2][r + 3] = t6;
-    B[c + 3][r + 0] = t1;
-    B[c + 3][r + 1] = t3;
-    B[c + 3][r + 2] = t5;
-    B[c + 3][r + 3] = t7;
+    t0 = LOAD(A[r + 0][c + 0]);
+    t1 = LOAD(A[r + 0][c + 1]);
+    t2 = LOAD(A[r + 1][c + 0]);
+    t3 = LOAD(A[r + 1][c + 1]);
+    t4 = LOAD(A[r + 2][c + 0]);
+    t5 = LOAD(A[r + 2][c + 1]);
+    t6 = LOAD(A[r + 3][c + 0]);
+    t7 = LOAD(A[r + 3][c + 1]);
+    STORE(B[c + 0][r + 0], t0);
+    STORE(B[c + 0][r + 1], t2);
+    STORE(B[c + 0][r + 2], t4);
+    STORE(B[c + 0][r + 3], t6);
+    STORE(B[c + 1][r + 0], t1);
+    STORE(B[c + 1][r + 1], t3);
+    STORE(B[c + 1][r + 2], t5);
+    STORE(B[c + 1][r + 3], t7);
+
+
+    t0 = LOAD(A[r + 0][c + 2]);
+    t1 = LOAD(A[r + 0][c + 3]);
+    t2 = LOAD(A[r + 1][c + 2]);
+    t3 = LOAD(A[r + 1][c + 3]);
+    t4 = LOAD(A[r + 2][c + 2]);
+    t5 = LOAD(A[r + 2][c + 3]);
+    t6 = LOAD(A[r + 3][c + 2]);
+    t7 = LOAD(A[r + 3][c + 3]);
+    STORE(B[c + 2][r + 0], t0);
+    STORE(B[c + 2][r + 1], t2);
+    STORE(B[c + 2][r + 2], t4);
+    STORE(B[c + 2][r + 3], t6);
+    STORE(B[c + 3][r + 0], t1);
+    STORE(B[c + 3][r + 1], t3);
+    STORE(B[c + 3][r + 2], t5);
+    STORE(B[c + 3][r + 3], t7);
 }
 
 void trans_square4(int r, int c, int N, int A[N][N], int B[N][N]) {
     int t0, t1, t2, t3, t4, t5, t6, t7;
-    t0 = A[r][c];
-    t1 = A[r][c + 1];
-    t2 = A[r][c + 2];
-    t3 = A[r][c + 3];
-    t4 = A[r + 1][c];
-    t5 = A[r + 1][c + 1];
-    t6 = A[r + 1][c + 2];
-    t7 = A[r + 1][c + 3];
-    B[c][r] = t0;
-    B[c + 1][r] = t1;
-    B[c + 2][r] = t2;
-    B[c + 3][r] = t3;
-    B[c][r + 1] = t4;
-    B[c + 1][r + 1] = t5;
-    B[c + 2][r + 1] = t6;
-    B[c + 3][r + 1] = t7;
-
-    t0 = A[r + 2][c];
-    t1 = A[r + 2][c + 1];
-    t2 = A[r + 2][c + 2];
-    t3 = A[r + 2][c + 3];
-    t4 = A[r + 3][c];
-    t5 = A[r + 3][c + 1];
-    t6 = A[r + 3][c + 2];
-    t7 = A[r + 3][c + 3];
-    B[c][r + 2] = t0;
-    B[c + 1][r + 2] = t1;
-    B[c + 2][r + 2] = t2;
-    B[c + 3][r + 2] = t3;
-    B[c][r + 3] = t4;
-    B[c + 1][r + 3] = t5;
-    B[c + 2][r + 3] = t6;
-    B[c + 3][r + 3] = t7;
+    t0 = LOAD(A[r][c]);
+    t1 = LOAD(A[r][c + 1]);
+    t2 = LOAD(A[r][c + 2]);
+    t3 = LOAD(A[r][c + 3]);
+    t4 = LOAD(A[r + 1][c]);
+    t5 = LOAD(A[r + 1][c + 1]);
+    t6 = LOAD(A[r + 1][c + 2]);
+    t7 = LOAD(A[r + 1][c + 3]);
+    STORE(B[c][r], t0);
+    STORE(B[c + 1][r], t1);
+    STORE(B[c + 2][r], t2);
+    STORE(B[c + 3][r], t3);
+    STORE(B[c][r + 1], t4);
+    STORE(B[c + 1][r + 1], t5);
+    STORE(B[c + 2][r + 1], t6);
+    STORE(B[c + 3][r + 1], t7);
+
+    t0 = LOAD(A[r + 2][c]);
+    t1 = LOAD(A[r + 2][c + 1]);
+    t2 = LOAD(A[r + 2][c + 2]);
+    t3 = LOAD(A[r + 2][c + 3]);
+    t4 = LOAD(A[r + 3][c]);
+    t5 = LOAD(A[r + 3][c + 1]);
+    t6 = LOAD(A[r + 3][c + 2]);
+    t7 = LOAD(A[r + 3][c + 3]);
+    STORE(B[c][r + 2], t0);
+    STORE(B[c + 1][r + 2], t1);
+    STORE(B[c + 2][r + 2], t2);
+    STORE(B[c + 3][r + 2], t3);
+    STORE(B[c][r + 3], t4);
+    STORE(B[c + 1][r + 3], t5);
+    STORE(B[c + 2][r + 3], t6);
+    STORE(B[c + 3][r + 3], t7);
 
 }
 
 void trans_square8(int r, int c, int N, int A[N][N], int B[N][N]) {
     for (int i = 0; i < 8; i++) {
-        int t0 = A[r * 8 + i][c * 8 + 0];
-        int t1 = A[r * 8 + i][c * 8 + 1];
-        int t2 = A[r * 8 + i][c * 8 + 2];
-        int t3 = A[r * 8 + i][c * 8 + 3];
-        int t4 = A[r * 8 + i][c * 8 + 4];
-        int t5 = A[r * 8 + i][c * 8 + 5];
-        int t6 = A[r * 8 + i][c * 8 + 6];
-        int t7 = A[r * 8 + i][c * 8 + 7];
-        B[c * 8 + 0][r * 8 + i] = t0;
-        B[c * 8 + 1][r * 8 + i] = t1;
-        B[c * 8 + 2][r * 8 + i] = t2;
-        B[c * 8 + 3][r * 8 + i] = t3;
-        B[c * 8 + 4][r * 8 + i] = t4;
-        B[c * 8 + 5][r * 8 + i] = t5;
-        B[c * 8 + 6][r * 8 + i] = t6;
-        B[c * 8 + 7][r * 8 + i] = t7;
+        int t0 = LOAD(A[r * 8 + i][c * 8 + 0]);
+        int t1 = LOAD(A[r * 8 + i][c * 8 + 1]);
+        int t2 = LOAD(A[r * 8 + i][c * 8 + 2]);
+        int t3 = LOAD(A[r * 8 + i][c * 8 + 3]);
+        int t4 = LOAD(A[r * 8 + i][c * 8 + 4]);
+        int t5 = LOAD(A[r * 8 + i][c * 8 + 5]);
+        int t6 = LOAD(A[r * 8 + i][c * 8 + 6]);
+        int t7 = LOAD(A[r * 8 + i][c * 8 + 7]);
+        STORE(B[c * 8 + 0][r * 8 + i], t0);
+        STORE(B[c * 8 + 1][r * 8 + i], t1);
+        STORE(B[c * 8 + 2][r * 8 + i], t2);
+        STORE(B[c * 8 + 3][r * 8 + i], t3);
+        STORE(B[c * 8 + 4][r * 8 + i], t4);
+        STORE(B[c * 8 + 5][r * 8 + i], t5);
+        STORE(B[c * 8 + 6][r * 8 + i], t6);
+        STORE(B[c * 8 + 7][r * 8 + i], t7);
     }
 }
 
 void trans_square8_v2(int r, int c, int N, int A[N][N], int B[N][N]) {
     for (int i = 0; i < 4; i++) {
         int t1, t2, t3, t4, t5, t6, t7, t0;
-        t0 = A[r * 8 + i * 2][c * 8 + 0];
-        t1 = A[r * 8 + i * 2][c * 8 + 1];
-        t2 = A[r * 8 + i * 2][c * 8 + 2];
-        t3 = A[r * 8 + i * 2][c * 8 + 3];
-        t4 = A[r * 8 + i * 2 + 1][c * 8 + 0];
-        t5 = A[r * 8 + i * 2 + 1][c * 8 + 1];
-        t6 = A[r * 8 + i * 2 + 1][c * 8 + 2];
-        t7 = A[r * 8 + i * 2 + 1][c * 8 + 3];
-        B[c * 8 + 0][r * 8 + i * 2] = t0;
-        B[c * 8 + 1][r * 8 + i * 2] = t1;
-        B[c * 8 + 2][r * 8 + i * 2] = t2;
-        B[c * 8 + 3][r * 8 + i * 2] = t3;
-        B[c * 8 + 0][r * 8 + i * 2 + 1] = t4;
-        B[c * 8 + 1][r * 8 + i * 2 + 1] = t5;
-        B[c * 8 + 2][r * 8 + i * 2 + 1] = t6;
-        B[c * 8 + 3][r * 8 + i * 2 + 1] = t7;
-
-        t0 = A[r * 8 + i * 2][c * 8 + 4];
-        t1 = A[r * 8 + i * 2][c * 8 + 5];
-        t2 = A[r * 8 + i * 2][c * 8 + 6];
-        t3 = A[r * 8 + i * 2][c * 8 + 7];
-        t4 = A[r * 8 + i * 2 + 1][c * 8 + 4];
-        t5 = A[r * 8 + i * 2 + 1][c * 8 + 5];
-        t6 = A[r * 8 + i * 2 + 1][c * 8 + 6];
-        t7 = A[r * 8 + i * 2 + 1][c * 8 + 7];
-        B[c * 8 + 4][r * 8 + i * 2] = t0;
-        B[c * 8 + 4][r * 8 + i * 2 + 1] = t4;
-        B[c * 8 + 5][r * 8 + i * 2] = t1;
-        B[c * 8 + 5][r * 8 + i * 2 + 1] = t5;
-        B[c * 8 + 6][r * 8 + i * 2] = t2;
-        B[c * 8 + 6][r * 8 + i * 2 + 1] = t6;
-        B[c * 8 + 7][r * 8 + i * 2] = t3;
-        B[c * 8 + 7][r * 8 + i * 2 + 1] = t7;
+        t0 = LOAD(A[r * 8 + i * 2][c * 8 + 0]);
+        t1 = LOAD(A[r * 8 + i * 2][c * 8 + 1]);
+        t2 = LOAD(A[r * 8 + i * 2][c * 8 + 2]);
+        t3 = LOAD(A[r * 8 + i * 2][c * 8 + 3]);
+        t4 = LOAD(A[r * 8 + i * 2 + 1][c * 8 + 0]);
+        t5 = LOAD(A[r * 8 + i * 2 + 1][c * 8 + 1]);
+        t6 = LOAD(A[r * 8 + i * 2 + 1][c * 8 + 2]);
+        t7 = LOAD(A[r * 8 + i * 2 + 1][c * 8 + 3]);
+        STORE(B[c * 8 + 0][r * 8 + i * 2], t0);
+        STORE(B[c * 8 + 1][r * 8 + i * 2], t1);
+        STORE(B[c * 8 + 2][r * 8 + i * 2], t2);
+        STORE(B[c * 8 + 3][r * 8 + i * 2], t3);
+        STORE(B[c * 8 + 0][r * 8 + i * 2 + 1], t4);
+        STORE(B[c * 8 + 1][r * 8 + i * 2 + 1], t5);
+        STORE(B[c * 8 + 2][r * 8 + i * 2 + 1], t6);
+        STORE(B[c * 8 + 3][r * 8 + i * 2 + 1], t7);
+
+        t0 = LOAD(A[r * 8 + i * 2][c * 8 + 4]);
+        t1 = LOAD(A[r * 8 + i * 2][c * 8 + 5]);
+        t2 = LOAD(A[r * 8 + i * 2][c * 8 + 6]);
+        t3 = LOAD(A[r * 8 + i * 2][c * 8 + 7]);
+        t4 = LOAD(A[r * 8 + i * 2 + 1][c * 8 + 4]);
+        t5 = LOAD(A[r * 8 + i * 2 + 1][c * 8 + 5]);
+        t6 = LOAD(A[r * 8 + i * 2 + 1][c * 8 + 6]);
+        t7 = LOAD(A[r * 8 + i * 2 + 1][c * 8 + 7]);
+        STORE(B[c * 8 + 4][r * 8 + i * 2], t0);
+        STORE(B[c * 8 + 4][r * 8 + i * 2 + 1], t4);
+        STORE(B[c * 8 + 5][r * 8 + i * 2], t1);
+        STORE(B[c * 8 + 5][r * 8 + i * 2 + 1], t5);
+        STORE(B[c * 8 + 6][r * 8 + i * 2], t2);
+        STORE(B[c * 8 + 6][r * 8 + i * 2 + 1], t6);
+        STORE(B[c * 8 + 7][r * 8 + i * 2], t3);
+        STORE(B[c * 8 + 7][r * 8 + i * 2 + 1], t7);
     }
 }
 
 void trans_square8_v3(int r, int c, int N, int A[N][N], int B[N][N]) {
     int t1, t2, t3, t4, t5, t6, t7, t0;
     for (int i = 0; i < 2; i++) {
-        t0 = A[r * 8 + i * 4 + 0][c * 8 + 0];
-        t1 = A[r * 8 + i * 4 + 0][c * 8 + 1];
-        t2 = A[r * 8 + i * 4 + 1][c * 8 + 0];
-        t3 = A[r * 8 + i * 4 + 1][c * 8 + 1];
-        t4 = A[r * 8 + i * 4 + 2][c * 8 + 0];
-        t5 = A[r * 8 + i * 4 + 2][c * 8 + 1];
-        t6 = A[r * 8 + i * 4 + 3][c * 8 + 0];
-        t7 = A[r * 8 + i * 4 + 3][c * 8 + 1];
-        B[c * 8 + 0][r * 8 + i * 4 + 0] = t0;
-        B[c * 8 + 0][r * 8 + i * 4 + 1] = t2;
-        B[c * 8 + 0][r * 8 + i * 4 + 2] = t4;
-        B[c * 8 + 0][r * 8 + i * 4 + 3] = t6;
-        B[c * 8 + 1][r * 8 + i * 4 + 0] = t1;
-        B[c * 8 + 1][r * 8 + i * 4 + 1] = t3;
-        B[c * 8 + 1][r * 8 + i * 4 + 2] = t5;
-        B[c * 8 + 1][r * 8 + i * 4 + 3] = t7;
-
-        t0 = A[r * 8 + i * 4 + 0][c * 8 + 2];
-        t1 = A[r * 8 + i * 4 + 0][c * 8 + 3];
-        t2 = A[r * 8 + i * 4 + 1][c * 8 + 2];
-        t3 = A[r * 8 + i * 4 + 1][c * 8 + 3];
-        t4 = A[r * 8 + i * 4 + 2][c * 8 + 2];
-        t5 = A[r * 8 + i * 4 + 2][c * 8 + 3];
-        t6 = A[r * 8 + i * 4 + 3][c * 8 + 2];
-        t7 = A[r * 8 + i * 4 + 3][c * 8 + 3];
-        B[c * 8 + 2][r * 8 + i * 4 + 0] = t0;
-        B[c * 8 + 2][r * 8 + i * 4 + 1] = t2;
-        B[c * 8 + 2][r * 8 + i * 4 + 2] = t4;
-        B[c * 8 + 2][r * 8 + i * 4 + 3] = t6;
-        B[c * 8 + 3][r * 8 + i * 4 + 0] = t1;
-        B[c * 8 + 3][r * 8 + i * 4 + 1] = t3;
-        B[c * 8 + 3][r * 8 + i * 4 + 2] = t5;
-        B[c * 8 + 3][r * 8 + i * 4 + 3] = t7;
-
-        t0 = A[r * 8 + i * 4 + 0][c * 8 + 2];
-        t1 = A[r * 8 + i * 4 + 0][c * 8 + 3];
-        t2 = A[r * 8 + i * 4 + 1][c * 8 + 2];
-        t3 = A[r * 8 + i * 4 + 1][c * 8 + 3];
-        t4 = A[r * 8 + i * 4 + 2][c * 8 + 2];
-        t5 = A[r * 8 + i * 4 + 2][c * 8 + 3];
-        t6 = A[r * 8 + i * 4 + 3][c * 8 + 2];
-        t7 = A[r * 8 + i * 4 + 3][c * 8 + 3];
-        B[c * 8 + 2][r * 8 + i * 4 + 0] = t0;
-        B[c * 8 + 2][r * 8 + i * 4 + 1] = t2;
-        B[c * 8 + 2][r * 8 + i * 4 + 2] = t4;
-        B[c * 8 + 2][r * 8 + i * 4 + 3] = t6;
-        B[c * 8 + 3][r * 8 + i * 4 + 0] = t1;
-        B[c * 8 + 3][r * 8 + i * 4 + 1] = t3;
-        B[c * 8 + 3][r * 8 + i * 4 + 2] = t5;
-        B[c * 8 + 3][r * 8 + i * 4 + 3] = t7;
-
-        t0 = A[r * 8 + i * 4 + 0][c * 8 + 4];
-        t1 = A[r * 8 + i * 4 + 0][c * 8 + 5];
-        t2 = A[r * 8 + i * 4 + 1][c * 8 + 4];
-        t3 = A[r * 8 + i * 4 + 1][c * 8 + 5];
-        t4 = A[r * 8 + i * 4 + 2][c * 8 + 4];
-        t5 = A[r * 8 + i * 4 + 2][c * 8 + 5];
-        t6 = A[r * 8 + i * 4 + 3][c * 8 + 4];
-        t7 = A[r * 8 + i * 4 + 3][c * 8 + 5];
-        B[c * 8 + 4][r * 8 + i * 4 + 0] = t0;
-        B[c * 8 + 4][r * 8 + i * 4 + 1] = t2;
-        B[c * 8 + 4][r * 8 + i * 4 + 2] = t4;
-        B[c * 8 + 4][r * 8 + i * 4 + 3] = t6;
-        B[c * 8 + 5][r * 8 + i * 4 + 0] = t1;
-        B[c * 8 + 5][r * 8 + i * 4 + 1] = t3;
-        B[c * 8 + 5][r * 8 + i * 4 + 2] = t5;
-        B[c * 8 + 5][r * 8 + i * 4 + 3] = t7;
-
-        t0 = A[r * 8 + i * 4 + 0][c * 8 + 6];
-        t1 = A[r * 8 + i * 4 + 0][c * 8 + 7];
-        t2 = A[r * 8 + i * 4 + 1][c * 8 + 6];
-        t3 = A[r * 8 + i * 4 + 1][c * 8 + 7];
-        t4 = A[r * 8 + i * 4 + 2][c * 8 + 6];
-        t5 = A[r * 8 + i * 4 + 2][c * 8 + 7];
-        t6 = A[r * 8 + i * 4 + 3][c * 8 + 6];
-        t7 = A[r * 8 + i * 4 + 3][c * 8 + 7];
-        B[c * 8 + 6][r * 8 + i * 4 + 0] = t0;
-        B[c * 8 + 6][r * 8 + i * 4 + 1] = t2;
-        B[c * 8 + 6][r * 8 + i * 4 + 2] = t4;
-        B[c * 8 + 6][r * 8 + i * 4 + 3] = t6;
-        B[c * 8 + 7][r * 8 + i * 4 + 0] = t1;
-        B[c * 8 + 7][r * 8 + i * 4 + 1] = t3;
-        B[c * 8 + 7][r * 8 + i * 4 + 2] = t5;
-        B[c * 8 + 7][r * 8 + i * 4 + 3] = t7;
+        t0 = LOAD(A[r * 8 + i * 4 + 0][c * 8 + 0]);
+        t1 = LOAD(A[r * 8 + i * 4 + 0][c * 8 + 1]);
+        t2 = LOAD(A[r * 8 + i * 4 + 1][c * 8 + 0]);
+        t3 = LOAD(A[r * 8 + i * 4 + 1][c * 8 + 1]);
+        t4 = LOAD(A[r * 8 + i * 4 + 2][c * 8 + 0]);
+        t5 = LOAD(A[r * 8 + i * 4 + 2][c * 8 + 1]);
+        t6 = LOAD(A[r * 8 + i * 4 + 3][c * 8 + 0]);
+        t7 = LOAD(A[r * 8 + i * 4 + 3][c * 8 + 1]);
+        STORE(B[c * 8 + 0][r * 8 + i * 4 + 0], t0);
+        STORE(B[c * 8 + 0][r * 8 + i * 4 + 1], t2);
+        STORE(B[c * 8 + 0][r * 8 + i * 4 + 2], t4);
+        STORE(B[c * 8 + 0][r * 8 + i * 4 + 3], t6);
+        STORE(B[c * 8 + 1][r * 8 + i * 4 + 0], t1);
+        STORE(B[c * 8 + 1][r * 8 + i * 4 + 1], t3);
+        STORE(B[c * 8 + 1][r * 8 + i * 4 + 2], t5);
+        STORE(B[c * 8 + 1][r * 8 + i * 4 + 3], t7);
+
+        t0 = LOAD(A[r * 8 + i * 4 + 0][c * 8 + 2]);
+        t1 = LOAD(A[r * 8 + i * 4 + 0][c * 8 + 3]);
+        t2 = LOAD(A[r * 8 + i * 4 + 1][c * 8 + 2]);
+        t3 = LOAD(A[r * 8 + i * 4 + 1][c * 8 + 3]);
+        t4 = LOAD(A[r * 8 + i * 4 + 2][c * 8 + 2]);
+        t5 = LOAD(A[r * 8 + i * 4 + 2][c * 8 + 3]);
+        t6 = LOAD(A[r * 8 + i * 4 + 3][c * 8 + 2]);
+        t7 = LOAD(A[r * 8 + i * 4 + 3][c * 8 + 3]);
+        STORE(B[c * 8 + 2][r * 8 + i * 4 + 0], t0);
+        STORE(B[c * 8 + 2][r * 8 + i * 4 + 1], t2);
+        STORE(B[c * 8 + 2][r * 8 + i * 4 + 2], t4);
+        STORE(B[c * 8 + 2][r * 8 + i * 4 + 3], t6);
+        STORE(B[c * 8 + 3][r * 8 + i * 4 + 0], t1);
+        STORE(B[c * 8 + 3][r * 8 + i * 4 + 1], t3);
+        STORE(B[c * 8 + 3][r * 8 + i * 4 + 2], t5);
+        STORE(B[c * 8 + 3][r * 8 + i * 4 + 3], t7);
+
+        t0 = LOAD(A[r * 8 + i * 4 + 0][c * 8 + 2]);
+        t1 = LOAD(A[r * 8 + i * 4 + 0][c * 8 + 3]);
+        t2 = LOAD(A[r * 8 + i * 4 + 1][c * 8 + 2]);
+        t3 = LOAD(A[r * 8 + i * 4 + 1][c * 8 + 3]);
+        t4 = LOAD(A[r * 8 + i * 4 + 2][c * 8 + 2]);
+        t5 = LOAD(A[r * 8 + i * 4 + 2][c * 8 + 3]);
+        t6 = LOAD(A[r * 8 + i * 4 + 3][c * 8 + 2]);
+        t7 = LOAD(A[r * 8 + i * 4 + 3][c * 8 + 3]);
+        STORE(B[c * 8 + 2][r * 8 + i * 4 + 0], t0);
+        STORE(B[c * 8 + 2][r * 8 + i * 4 + 1], t2);
+        STORE(B[c * 8 + 2][r * 8 + i * 4 + 2], t4);
+        STORE(B[c * 8 + 2][r * 8 + i * 4 + 3], t6);
+        STORE(B[c * 8 + 3][r * 8 + i * 4 + 0], t1);
+        STORE(B[c * 8 + 3][r * 8 + i * 4 + 1], t3);
+        STORE(B[c * 8 + 3][r * 8 + i * 4 + 2], t5);
+        STORE(B[c * 8 + 3][r * 8 + i * 4 + 3], t7);
+
+        t0 = LOAD(A[r * 8 + i * 4 + 0][c * 8 + 4]);
+        t1 = LOAD(A[r * 8 + i * 4 + 0][c * 8 + 5]);
+        t2 = LOAD(A[r * 8 + i * 4 + 1][c * 8 + 4]);
+        t3 = LOAD(A[r * 8 + i * 4 + 1][c * 8 + 5]);
+        t4 = LOAD(A[r * 8 + i * 4 + 2][c * 8 + 4]);
+        t5 = LOAD(A[r * 8 + i * 4 + 2][c * 8 + 5]);
+        t6 = LOAD(A[r * 8 + i * 4 + 3][c * 8 + 4]);
+        t7 = LOAD(A[r * 8 + i * 4 + 3][c * 8 + 5]);
+        STORE(B[c * 8 + 4][r * 8 + i * 4 + 0], t0);
+        STORE(B[c * 8 + 4][r * 8 + i * 4 + 1], t2);
+        STORE(B[c * 8 + 4][r * 8 + i * 4 + 2], t4);
+        STORE(B[c * 8 + 4][r * 8 + i * 4 + 3], t6);
+        STORE(B[c * 8 + 5][r * 8 + i * 4 + 0], t1);
+        STORE(B[c * 8 + 5][r * 8 + i * 4 + 1], t3);
+        STORE(B[c * 8 + 5][r * 8 + i * 4 + 2], t5);
+        STORE(B[c * 8 + 5][r * 8 + i * 4 + 3], t7);
+
+        t0 = LOAD(A[r * 8 + i * 4 + 0][c * 8 + 6]);
+        t1 = LOAD(A[r * 8 + i * 4 + 0][c * 8 + 7]);
+        t2 = LOAD(A[r * 8 + i * 4 + 1][c * 8 + 6]);
+        t3 = LOAD(A[r * 8 + i * 4 + 1][c * 8 + 7]);
+        t4 = LOAD(A[r * 8 + i * 4 + 2][c * 8 + 6]);
+        t5 = LOAD(A[r * 8 + i * 4 + 2][c * 8 + 7]);
+        t6 = LOAD(A[r * 8 + i * 4 + 3][c * 8 + 6]);
+        t7 = LOAD(A[r * 8 + i * 4 + 3][c * 8 + 7]);
+        STORE(B[c * 8 + 6][r * 8 + i * 4 + 0], t0);
+        STORE(B[c * 8 + 6][r * 8 + i * 4 + 1], t2);
+        STORE(B[c * 8 + 6][r * 8 + i * 4 + 2], t4);
+        STORE(B[c * 8 + 6][r * 8 + i * 4 + 3], t6);
+        STORE(B[c * 8 + 7][r * 8 + i * 4 + 0], t1);
+        STORE(B[c * 8 + 7][r * 8 + i * 4 + 1], t3);
+        STORE(B[c * 8 + 7][r * 8 + i * 4 + 2], t5);
+        STORE(B[c * 8 + 7][r * 8 + i * 4 + 3], t7);
     }
 }
 
 void trans_square8_v4(int r, int c, int N, int A[N][N], int B[N][N]) {
     int t1, t2, t3, t4, t5, t6, t7, t0;
     for (int i = 0; i < 8; i++) {
-        t0 = A[r * 8 + 0][c * 8 + i];
-        t1 = A[r * 8 + 1][c * 8 + i];
-        t2 = A[r * 8 + 2][c * 8 + i];
-        t3 = A[r * 8 + 3][c * 8 + i];
-        t4 = A[r * 8 + 4][c * 8 + i];
-        t5 = A[r * 8 + 5][c * 8 + i];
-        t6 = A[r * 8 + 6][c * 8 + i];
-        t7 = A[r * 8 + 7][c * 8 + i];
-
-        B[c * 8 + i][r * 8 + 0] = t0;
-        B[c * 8 + i][r * 8 + 1] = t1;
-        B[c * 8 + i][r * 8 + 2] = t2;
-        B[c * 8 + i][r * 8 + 3] = t3;
-        B[c * 8 + i][r * 8 + 4] = t4;
-        B[c * 8 + i][r * 8 + 5] = t5;
-        B[c * 8 + i][r * 8 + 6] = t6;
-        B[c * 8 + i][r * 8 + 7] = t7;
+        t0 = LOAD(A[r * 8 + 0][c * 8 + i]);
+        t1 = LOAD(A[r * 8 + 1][c * 8 + i]);
+        t2 = LOAD(A[r * 8 + 2][c * 8 + i]);
+        t3 = LOAD(A[r * 8 + 3][c * 8 + i]);
+        t4 = LOAD(A[r * 8 + 4][c * 8 + i]);
+        t5 = LOAD(A[r * 8 + 5][c * 8 + i]);
+        t6 = LOAD(A[r * 8 + 6][c * 8 + i]);
+        t7 = LOAD(A[r * 8 + 7][c * 8 + i]);
+
+        STORE(B[c * 8 + i][r * 8 + 0], t0);
+        STORE(B[c * 8 + i][r * 8 + 1], t1);
+        STORE(B[c * 8 + i][r * 8 + 2], t2);
+        STORE(B[c * 8 + i][r * 8 + 3], t3);
+        STORE(B[c * 8 + i][r * 8 + 4], t4);
+        STORE(B[c * 8 + i][r * 8 + 5], t5);
+        STORE(B[c * 8 + i][r * 8 + 6], t6);
+        STORE(B[c * 8 + i][r * 8 + 7], t7);
     }
 }
 
 void trans_square8_v5(int r, int c, int N, int A[N][N], int B[N][N]) {
     int t0, t1, t2, t3, t4, t5, t6, t7;
     for (int i = 0; i < 4; i++) {
-        t0 = A[r + i][c + 0];
-        t1 = A[r + i][c + 1];
-        t2 = A[r + i][c + 2];
-        t3 = A[r + i][c + 3];
-        t4 = A[r + i][c + 4];
-        t5 = A[r + i][c + 5];
-        t6 = A[r + i][c + 6];
-        t7 = A[r + i][c + 7];
-        B[c + 0][r + i] = t0;
-        B[c + 1][r + i] = t1;
-        B[c + 2][r + i] = t2;
-        B[c + 3][r + i] = t3;
-        B[c + 4][r + i] = t4;
-        B[c + 5][r + i] = t5;
-        B[c + 6][r + i] = t6;
-        B[c + 7][r + i] = t7;
+        t0 = LOAD(A[r + i][c + 0]);
+        t1 = LOAD(A[r + i][c + 1]);
+        t2 = LOAD(A[r + i][c + 2]);
+        t3 = LOAD(A[r + i][c + 3]);
+        t4 = LOAD(A[r + i][c + 4]);
+        t5 = LOAD(A[r + i][c + 5]);
+        t6 = LOAD(A[r + i][c + 6]);
+        t7 = LOAD(A[r + i][c + 7]);
+        STORE(B[c + 0][r + i], t0);
+        STORE(B[c + 1][r + i], t1);
+        STORE(B[c + 2][r + i], t2);
+        STORE(B[c + 3][r + i], t3);
+        STORE(B[c + 4][r + i], t4);
+        STORE(B[c + 5][r + i], t5);
+        STORE(B[c + 6][r + i], t6);
+        STORE(B[c + 7][r + i], t7);
     }
     trans_square4_v2(r + 4, c, N, A, B);
     trans_square4_v2(r + 4, c + 4, N, A, B);
@@ -323,22 +330,22 @@ void trans_square32(int r, int c, int N, int A[N][N], int B[N][N]) {
     for (int i = 0; i < 32; i++) {
         for (int j = 0; j < 4; j++) {
             int t0, t1, t2, t3, t4, t5, t6, t7;
-            t0 = A[r * 32 + i][c * 32 + j * 8 + 0];
-            t1 = A[r * 32 + i][c * 32 + j * 8 + 1];
-            t2 = A[r * 32 + i][c * 32 + j * 8 + 2];
-            t3 = A[r * 32 + i][c * 32 + j * 8 + 3];
-            t4 = A[r * 32 + i][c * 32 + j * 8 + 4];
-            t5 = A[r * 32 + i][c * 32 + j * 8 + 5];
-            t6 = A[r * 32 + i][c * 32 + j * 8 + 6];
-            t7 = A[r * 32 + i][c * 32 + j * 8 + 7];
-            B[c * 32 + j * 8 + 0][r * 32 + i] = t0;
-            B[c * 32 + j * 8 + 1][r * 32 + i] = t1;
-            B[c * 32 + j * 8 + 2][r * 32 + i] = t2;
-            B[c * 32 + j * 8 + 3][r * 32 + i] = t3;
-            B[c * 32 + j * 8 + 4][r * 32 + i] = t4;
-            B[c * 32 + j * 8 + 5][r * 32 + i] = t5;
-            B[c * 32 + j * 8 + 6][r * 32 + i] = t6;
-            B[c * 32 + j * 8 + 7][r * 32 + i] = t7;
+            t0 = LOAD(A[r * 32 + i][c * 32 + j * 8 + 0]);
+            t1 = LOAD(A[r * 32 + i][c * 32 + j * 8 + 1]);
+            t2 = LOAD(A[r * 32 + i][c * 32 + j * 8 + 2]);
+            t3 = LOAD(A[r * 32 + i][c * 32 + j * 8 + 3]);
+            t4 = LOAD(A[r * 32 + i][c * 32 + j * 8 + 4]);
+            t5 = LOAD(A[r * 32 + i][c * 32 + j * 8 + 5]);
+            t6 = LOAD(A[r * 32 + i][c * 32 + j * 8 + 6]);
+            t7 = LOAD(A[r * 32 + i][c * 32 + j * 8 + 7]);
+            STORE(B[c * 32 + j * 8 + 0][r * 32 + i], t0);
+            STORE(B[c * 32 + j * 8 + 1][r * 32 + i], t1);
+            STORE(B[c * 32 + j * 8 + 2][r * 32 + i], t2);
+            STORE(B[c * 32 + j * 8 + 3][r * 32 + i], t3);
+            STORE(B[c * 32 + j * 8 + 4][r * 32 + i], t4);
+            STORE(B[c * 32 + j * 8 + 5][r * 32 + i], t5);
+            STORE(B[c * 32 + j * 8 + 6][r * 32 + i], t6);
+            STORE(B[c * 32 + j * 8 + 7][r * 32 + i], t7);
         }
     }
 }
@@ -359,54 +366,54 @@ void transpose_submit(int M, int N, int A[N][M], int B[M][N]) {
         for (i = 0; i < N; i += 8)
             for (j = 0; j < M; j += 8) {
                 for (x = i; x < i + 4; ++x) {
-                    x1 = A[x][j];
-                    x2 = A[x][j + 1];
-                    x3 = A[x][j + 2];
-                    x4 = A[x][j + 3];
-                    x5 = A[x][j + 4];
-                    x6 = A[x][j + 5];
-                    x7 = A[x][j + 6];
-                    x8 = A[x][j + 7];
-
-                    B[j][x] = x1;
-                    B[j + 1][x] = x2;
-                    B[j + 2][x] = x3;
-                    B[j + 3][x] = x4;
-                    B[j][x + 4] = x5;
-                    B[j + 1][x + 4] = x6;
-                    B[j + 2][x + 4] = x7;
-                    B[j + 3][x + 4] = x8;
+                    x1 = LOAD(A[x][j]);
+                    x2 = LOAD(A[x][j + 1]);
+                    x3 = LOAD(A[x][j + 2]);
+                    x4 = LOAD(A[x][j + 3]);
+                    x5 = LOAD(A[x][j + 4]);
+                    x6 = LOAD(A[x][j + 5]);
+                    x7 = LOAD(A[x][j + 6]);
+                    x8 = LOAD(A[x][j + 7]);
+
+                    STORE(B[j][x], x1);
+                    STORE(B[j + 1][x], x2);
+                    STORE(B[j + 2][x], x3);
+                    STORE(B[j + 3][x], x4);
+                    STORE(B[j][x + 4], x5);
+                    STORE(B[j + 1][x + 4], x6);
+                    STORE(B[j + 2][x + 4], x7);
+                    STORE(B[j + 3][x + 4], x8);
                 }
 
                 // cover
                 for (y = j; y < j + 4; ++y) {
-                    x1 = A[i + 4][y];
-                    x2 = A[i + 5][y];
-                    x3 = A[i + 6][y];
-                    x4 = A[i + 7][y];
-                    x5 = B[y][i + 4];
-                    x6 = B[y][i + 5];
-                    x7 = B[y][i + 6];
-                    x8 = B[y][i + 7];
-
-                    B[y][i + 4] = x1;
-                    B[y][i + 5] = x2;
-                    B[y][i + 6] = x3;
-                    B[y][i + 7] = x4;
-                    B[y + 4][i] = x5;
-                    B[y + 4][i + 1] = x6;
-                    B[y + 4][i + 2] = x7;
-                    B[y + 4][i + 3] = x8;
+                    x1 = LOAD(A[i + 4][y]);
+                    x2 = LOAD(A[i + 5][y]);
+                    x3 = LOAD(A[i + 6][y]);
+                    x4 = LOAD(A[i + 7][y]);
+                    x5 = LOAD(B[y][i + 4]);
+                    x6 = LOAD(B[y][i + 5]);
+                    x7 = LOAD(B[y][i + 6]);
+                    x8 = LOAD(B[y][i + 7]);
+
+                    STORE(B[y][i + 4], x1);
+                    STORE(B[y][i + 5], x2);
+                    STORE(B[y][i + 6], x3);
+                    STORE(B[y][i + 7], x4);
+                    STORE(B[y + 4][i], x5);
+                    STORE(B[y + 4][i + 1], x6);
+                    STORE(B[y + 4][i + 2], x7);
+                    STORE(B[y + 4][i + 3], x8);
                 }
                 for (x = i + 4; x < i + 8; ++x) {
-                    x1 = A[x][j + 4];
-                    x2 = A[x][j + 5];
-                    x3 = A[x][j + 6];
-                    x4 = A[x][j + 7];
-                    B[j + 4][x] = x1;
-                    B[j + 5][x] = x2;
-                    B[j + 6][x] = x3;
-                    B[j + 7][x] = x4;
+                    x1 = LOAD(A[x][j + 4]);
+                    x2 = LOAD(A[x][j + 5]);
+                    x3 = LOAD(A[x][j + 6]);
+                    x4 = LOAD(A[x][j + 7]);
+                    STORE(B[j + 4][x], x1);
+                    STORE(B[j + 5][x], x2);
+                    STORE(B[j + 6][x], x3);
+                    STORE(B[j + 7][x], x4);
                 }
             }
 //        for (int i = 0; i < 8; i++) {
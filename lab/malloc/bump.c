@@ -0,0 +1,113 @@
+/*
+ * bump.c - A bump allocator over memlib, vendored as a baseline.
+ *
+ * Each block is an ALIGNMENT-byte header holding the aligned payload
+ * size, followed by the payload, carved from the top of the heap. The
+ * heap grows with mem_sbrk at least a page at a time, and never
+ * shrinks. Nothing is ever reused except at the top: freeing the most
+ * recent block lowers the top again, and the most recent block grows
+ * or shrinks in place on realloc. Any other realloc copies to a
+ * new block and leaks the old one. This is the fastest any allocator
+ * can be, and shows how much an allocator's reuse is worth in space.
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "bump.h"
+#include "memlib.h"
+#include "config.h"
+
+/* rounds up to the nearest multiple of ALIGNMENT */
+#define ALIGN(size) (((size) + (ALIGNMENT-1)) & ~(size_t) (ALIGNMENT-1))
+
+/* the aligned payload size in the header before payload p */
+#define SIZE(p) (*(size_t *) ((char *) (p) - ALIGNMENT))
+
+static char *top = NULL;   /* first free byte of the heap */
+static char *end = NULL;   /* the brk */
+static char *last = NULL;  /* payload of the block just below top */
+
+/* function prototypes */
+static int reserve(size_t bytes);
+
+/*
+ * bump_init - start with an empty heap. The caller resets the memlib heap.
+ */
+int bump_init(void) {
+    top = end = (char *) mem_heap_lo();
+    last = NULL;
+    return 0;
+}
+
+/*
+ * bump_malloc - carve a block from the top of the heap
+ */
+void *bump_malloc(size_t size) {
+    size_t asize = ALIGN(size);
+
+    if (reserve(ALIGNMENT + asize) < 0)
+        return NULL;
+    last = top + ALIGNMENT;
+    SIZE(last) = asize;
+    top = last + asize;
+    return last;
+}
+
+/*
+ * bump_free - lower the top if ptr is the top block, else do nothing
+ */
+void bump_free(void *ptr) {
+    if (ptr != NULL && ptr == last) {
+        top = last - ALIGNMENT;
+        last = NULL;
+    }
+}
+
+/*
+ * bump_realloc - resize the top block in place, or copy to a new one
+ */
+void *bump_realloc(void *ptr, size_t size) {
+    size_t asize = ALIGN(size);
+    size_t oldsize;
+    void *newptr;
+
+    if (ptr == NULL)
+        return bump_malloc(size);
+    if (ptr == last) {
+        top = last;
+        if (reserve(asize) < 0) {
+            top = last + SIZE(last);
+            return NULL;
+        }
+        SIZE(last) = asize;
+        top = last + asize;
+        return ptr;
+    }
+    if ((newptr = bump_malloc(size)) == NULL)
+        return NULL;
+    oldsize = SIZE(ptr);
+    memcpy(newptr, ptr, oldsize < size ? oldsize : size);
+    return newptr;
+}
+
+/*
+ * reserve - make sure there are bytes free above top, extending the
+ *     heap by at least a page if there are not. Fails without calling
+ *     mem_sbrk, which would complain, when the heap cannot grow that
+ *     far: the leaking realloc runs out of heap on some traces.
+ */
+static int reserve(size_t bytes) {
+    size_t need;
+    size_t page = mem_pagesize();
+
+    if (bytes <= (size_t) (end - top))
+        return 0;
+    need = bytes - (size_t) (end - top);
+    need = (need + page - 1) & ~(page - 1);
+    if (need < bytes - (size_t) (end - top) || need > MAX_HEAP - mem_heapsize())
+        return -1;
+    if (mem_sbrk((int) need) == (void *) -1)
+        return -1;
+    end += need;
+    return 0;
+}
@@ -0,0 +1,11 @@
+#include <stdio.h>
+
+/*
+ * A bump allocator: the simplest baseline for mdriver -b. It carves
+ * every block from the end of the memlib heap, and only gives memory
+ * back when the most recent block is freed or shrunk.
+ */
+extern int bump_init(void);
+extern void *bump_malloc(size_t size);
+extern void bump_free(void *ptr);
+extern void *bump_realloc(void *ptr, size_t size);
@@ -52,6 +52,15 @@
   "realloc-bal.rep",\
   "realloc2-bal.rep"
 
+/*
+ * These are the default tracefiles of the -s mode, which compares the
+ * slab allocator with mm malloc. They allocate objects of only a few
+ * distinct sizes and never realloc.
+ */
+#define SLAB_TRACEFILES \
+  "objpool-slab.rep",\
+  "conncache-slab.rep"
+
 /*
  * This constant gives the estimated performance of the libc malloc
  * package using our traces on some reference system, typically the
@@ -71,20 +80,45 @@
 #define UTIL_WEIGHT .60
 
 /* 
- * Alignment requirement in bytes (either 4 or 8) 
+ * Alignment requirement in bytes (8, 16 or 32). 64-bit builds align
+ * payloads to 16 bytes so they can hold SSE values; compile with
+ * -DALIGNMENT=32 for AVX.
  */
+#ifndef ALIGNMENT
+#if defined(__LP64__)
+#define ALIGNMENT 16
+#else
 #define ALIGNMENT 8
+#endif
+#endif
 
 /* 
  * Maximum heap size in bytes 
  */
 #define MAX_HEAP (20*(1<<20))  /* 20 MB */
 
+/*
+ * Set MEM_USE_MMAP to "1" to back the heap with a PROT_NONE mmap
+ * reservation of MAX_HEAP bytes whose pages are committed as brk grows
+ * and given back to the kernel when brk shrinks. Set it to "0" to model
+ * the heap with a plain malloc'd array.
+ */
+#define MEM_USE_MMAP 1
+
+/*
+ * Set MEM_HUGEPAGES to "1" to align the mmap reservation to HUGE_PAGESIZE,
+ * ask for transparent huge pages with madvise(MADV_HUGEPAGE), and commit
+ * and release the heap in whole huge pages. Requires MEM_USE_MMAP.
+ */
+#define MEM_HUGEPAGES 0
+#define HUGE_PAGESIZE (2*(1<<20))  /* 2 MB */
+
 /*****************************************************************************
  * Set exactly one of these USE_xxx constants to "1" to select a timing method
  *****************************************************************************/
-#define USE_FCYC   0   /* cycle counter w/K-best scheme (x86 & Alpha only) */
+#define USE_FCYC   0   /* cycle counter w/K-best scheme (x86-32 & Alpha only) */
+#define USE_TSC    1   /* invariant TSC w/K-best scheme (x86-64, else clock_gettime) */
 #define USE_ITIMER 0   /* interval timer (any Unix box) */
-#define USE_GETTOD 1   /* gettimeofday (any Unix box) */
+#define USE_GETTOD 0   /* gettimeofday (any Unix box) */
 
 #endif /* __CONFIG_H */
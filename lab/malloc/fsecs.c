@@ -6,6 +6,7 @@
 #include "fcyc.h"
 #include "clock.h"
 #include "ftimer.h"
+#include "tsc.h"
 #include "config.h"
 
 static double Mhz;  /* estimated CPU clock frequency */
@@ -29,6 +30,12 @@ void init_fsecs(void) {
     set_fcyc_epsilon(0.01);
     set_fcyc_k(3);
     Mhz = mhz(verbose > 0);
+#elif USE_TSC
+    /* set key parameters for the tsc package */
+    set_tsc_maxsamples(20);
+    set_tsc_epsilon(0.01);
+    set_tsc_k(3);
+    Mhz = init_tsc(verbose > 0);
 #elif USE_ITIMER
     if (verbose)
     printf("Measuring performance with the interval timer.\n");
@@ -38,6 +45,16 @@ void init_fsecs(void) {
 #endif
 }
 
+/*
+ * unpin_fsecs - undo any CPU pinning done by init_fsecs, so threads
+ *     created afterwards can run on every CPU
+ */
+void unpin_fsecs(void) {
+#if USE_TSC
+    unpin_tsc();
+#endif
+}
+
 /*
  * fsecs - Return the running time of a function f (in seconds)
  */
@@ -45,6 +62,8 @@ double fsecs(fsecs_test_funct f, void *argp) {
 #if USE_FCYC
     double cycles = fcyc(f, argp);
     return cycles/(Mhz*1e6);
+#elif USE_TSC
+    return ftsc(f, argp);
 #elif USE_ITIMER
     return ftimer_itimer(f, argp, 10);
 #elif USE_GETTOD
@@ -0,0 +1,565 @@
+/*
+ * gentrace.c - Generate synthetic mdriver traces from parametric
+ *     allocation profiles, or turn a recorded profile into a trace.
+ *
+ * A trace is built from one or more phases. The -s, -l and -r flags set
+ * the size distribution, lifetime distribution and realloc behaviour of
+ * the phases that follow them, and every -n flag emits a phase of that
+ * many allocations using the current settings. For example
+ *
+ *   gentrace -s hist:16:50,64:30,512:15,8192:5 -l exp:2000 -n 1000000 \
+ *            -s exp:256 -l uniform:1:50 -r 0.05:1.5 -n 4000000 -o big.rep
+ *
+ * emits a trace with a 1M-allocation phase of small long-lived blocks,
+ * followed by a 4M-allocation phase of short-lived exponential sizes in
+ * which 5% of the steps also grow a live block by half. A block lives
+ * for its lifetime in allocation steps, then is freed; once all phases
+ * are done, the remaining blocks are freed so the trace is balanced.
+ *
+ * Distributions (sizes in bytes, lifetimes in allocation steps):
+ *   uniform:LO:HI            uniform integer in [LO, HI]
+ *   exp:MEAN                 exponential with the given mean
+ *   lognormal:MU:SIGMA       exp(N(MU, SIGMA))
+ *   hist:V1:W1,V2:W2,...     bucket (V(i-1), Vi] with weight Wi, then
+ *                            uniform within the bucket
+ *
+ * With -R, the allocation profile recorded by libmtrace.so is turned
+ * into a trace instead, mapping every block address to a fresh id.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <stdint.h>
+
+#include "tracefmt.h"
+
+#define MAXBUCKETS 64           /* max buckets in a hist: distribution */
+#define MAXPHASES  64           /* max phases (-n flags) per trace */
+#define MAXSIZE    (1 << 26)    /* largest block the generator emits */
+
+/* A size or lifetime distribution */
+typedef struct {
+    enum {
+        UNIFORM, EXPONENTIAL, LOGNORMAL, HISTOGRAM
+    } kind;
+    double a, b;                 /* parameters of the first three kinds */
+    int nbuckets;                /* histogram buckets... */
+    double bound[MAXBUCKETS];    /* ... upper bound of each bucket */
+    double cumw[MAXBUCKETS];     /* ... and cumulative weight up to it */
+} dist_t;
+
+/* Parameters of one phase of the generated trace */
+typedef struct {
+    long num_allocs;             /* allocations in this phase */
+    dist_t size;                 /* block size distribution */
+    dist_t life;                 /* block lifetime distribution */
+    double realloc_prob;         /* chance per step to grow a live block */
+    double realloc_growth;       /* factor a realloc grows the block by */
+} phase_t;
+
+/* A scheduled free: the live block id dies at step death */
+typedef struct {
+    uint64_t death;
+    uint32_t id;
+} event_t;
+
+/* The trace under construction */
+static uint32_t *ops = NULL, *sizes = NULL;
+static long num_ops = 0, max_ops = 0;
+static uint32_t num_ids = 0;
+static uint32_t *block_size = NULL;
+static uint32_t max_ids = 0;
+static uint64_t live_bytes = 0, peak_bytes = 0;
+
+/* Live blocks, as a min-heap on death step */
+static event_t *heap = NULL;
+static long heap_len = 0, heap_max = 0;
+
+static uint64_t rng_state = 0x9e3779b97f4a7c15ULL;
+
+/* function prototypes */
+static void usage(char *prog);
+static void parse_dist(char *spec, dist_t *d);
+static double sample(dist_t *d);
+static double urand(void);
+static void emit(uint32_t type, uint32_t id, uint32_t size);
+static uint32_t new_id(void);
+static void heap_push(uint64_t death, uint32_t id);
+static event_t heap_pop(void);
+static void free_block(uint32_t id);
+static void generate(phase_t *phases, int nphases, uint64_t max_live);
+static void read_profile(char *path);
+static void write_trace(char *path, int binary);
+
+int main(int argc, char **argv) {
+    phase_t phases[MAXPHASES];
+    phase_t cur;
+    int nphases = 0;
+    char *out = NULL, *profile = NULL;
+    uint64_t max_live = 8 << 20;
+    int binary = 0;
+    int c;
+
+    memset(&cur, 0, sizeof(cur));
+    parse_dist("exp:128", &cur.size);
+    parse_dist("exp:1000", &cur.life);
+    cur.realloc_growth = 2.0;
+
+    while ((c = getopt(argc, argv, "s:l:r:n:M:S:R:o:bh")) != EOF) {
+        switch (c) {
+            case 's': /* Size distribution of the following phases */
+                parse_dist(optarg, &cur.size);
+                break;
+            case 'l': /* Lifetime distribution of the following phases */
+                parse_dist(optarg, &cur.life);
+                break;
+            case 'r': /* Realloc probability and growth factor */
+                if (sscanf(optarg, "%lf:%lf", &cur.realloc_prob,
+                           &cur.realloc_growth) != 2) {
+                    fprintf(stderr, "bad realloc spec %s\n", optarg);
+                    exit(1);
+                }
+                break;
+            case 'n': /* Emit a phase with this many allocations */
+                if (nphases == MAXPHASES) {
+                    fprintf(stderr, "too many phases\n");
+                    exit(1);
+                }
+                cur.num_allocs = atol(optarg);
+                phases[nphases++] = cur;
+                break;
+            case 'M': /* Cap on live bytes, in KB */
+                max_live = (uint64_t) atol(optarg) << 10;
+                break;
+            case 'S': /* Random seed */
+                rng_state = strtoull(optarg, NULL, 0) | 1;
+                break;
+            case 'R': /* Convert a recorded profile */
+                profile = optarg;
+                break;
+            case 'o': /* Output file */
+                out = optarg;
+                break;
+            case 'b': /* Binary output */
+                binary = 1;
+                break;
+            case 'h':
+            default:
+                usage(argv[0]);
+        }
+    }
+    if (out == NULL || (profile == NULL && nphases == 0))
+        usage(argv[0]);
+
+    if (profile)
+        read_profile(profile);
+    else
+        generate(phases, nphases, max_live);
+    write_trace(out, binary);
+
+    fprintf(stderr, "%s: %ld ops, %u ids, peak live %llu bytes\n",
+            out, num_ops, num_ids, (unsigned long long) peak_bytes);
+    return 0;
+}
+
+/*
+ * generate - run every phase, then free what is still live
+ */
+static void generate(phase_t *phases, int nphases, uint64_t max_live) {
+    uint64_t step = 0;
+    phase_t *ph;
+    event_t ev;
+    uint32_t id, size;
+    double life, grown;
+    long i;
+    int p, gone;
+
+    for (p = 0; p < nphases; p++) {
+        ph = &phases[p];
+        for (i = 0; i < ph->num_allocs; i++, step++) {
+            /* Free the blocks whose lifetime is over */
+            while (heap_len > 0 && heap[0].death <= step) {
+                ev = heap_pop();
+                free_block(ev.id);
+            }
+
+            size = (uint32_t) sample(&ph->size);
+            size = (size < 1) ? 1 : (size > MAXSIZE) ? MAXSIZE : size;
+
+            /* Stay under the live byte cap by ending lives early */
+            while (heap_len > 0 && live_bytes + size > max_live) {
+                ev = heap_pop();
+                free_block(ev.id);
+            }
+
+            /* Sometimes grow a random live block, ending more lives
+               early to keep room for it under the cap. If that ends
+               the block's own life, it is not grown. */
+            if (heap_len > 0 && urand() < ph->realloc_prob) {
+                id = heap[(long) (urand() * heap_len)].id;
+                grown = block_size[id] * ph->realloc_growth;
+                grown = (grown < 1) ? 1 : (grown > MAXSIZE) ? MAXSIZE : grown;
+                gone = 0;
+                while (heap_len > 0 && !gone &&
+                       live_bytes - block_size[id] + (uint32_t) grown + size > max_live) {
+                    ev = heap_pop();
+                    free_block(ev.id);
+                    gone = (ev.id == id);
+                }
+                if (!gone) {
+                    live_bytes = live_bytes - block_size[id] + (uint32_t) grown;
+                    block_size[id] = (uint32_t) grown;
+                    emit(TRACE_REALLOC, id, block_size[id]);
+                }
+            }
+
+            id = new_id();
+            block_size[id] = size;
+            live_bytes += size;
+            emit(TRACE_ALLOC, id, size);
+
+            life = sample(&ph->life);
+            heap_push(step + (life < 1 ? 1 : (uint64_t) life), id);
+        }
+    }
+
+    while (heap_len > 0) {
+        ev = heap_pop();
+        free_block(ev.id);
+    }
+}
+
+/*
+ * read_profile - turn a libmtrace.so profile into a trace. Addresses
+ *     are mapped to ids with an open-addressing hash table; frees of
+ *     blocks allocated before recording started are dropped.
+ */
+static void read_profile(char *path) {
+    FILE *fp;
+    profrec_t rec;
+    uint64_t *keys = NULL;
+    uint32_t *vals = NULL;
+    uint64_t mask = 0, h, slots = 0, used = 0;
+    uint32_t id;
+    uint64_t i;
+
+    if ((fp = fopen(path, "rb")) == NULL) {
+        perror(path);
+        exit(1);
+    }
+
+#define SLOT(ptr) for (h = ((ptr) * 0x9e3779b97f4a7c15ULL) & mask; \
+                       keys[h] != 0 && keys[h] != (ptr); h = (h + 1) & mask)
+
+    while (fread(&rec, sizeof(rec), 1, fp) == 1) {
+        /* Keep the table at most half full, growing it by rehashing */
+        if (2 * (used + 1) > slots) {
+            uint64_t *okeys = keys;
+            uint32_t *ovals = vals;
+            uint64_t oslots = slots;
+            slots = slots ? 2 * slots : 1 << 16;
+            mask = slots - 1;
+            keys = (uint64_t *) calloc(slots, sizeof(uint64_t));
+            vals = (uint32_t *) calloc(slots, sizeof(uint32_t));
+            if (keys == NULL || vals == NULL) {
+                fprintf(stderr, "out of memory\n");
+                exit(1);
+            }
+            used = 0;
+            for (i = 0; i < oslots; i++) {
+                if (okeys[i] != 0 && ovals[i] != UINT32_MAX) {
+                    SLOT(okeys[i]);
+                    keys[h] = okeys[i];
+                    vals[h] = ovals[i];
+                    used++;
+                }
+            }
+            free(okeys);
+            free(ovals);
+        }
+
+        if (rec.op == TRACE_REALLOC && rec.ptr == 0)
+            rec.op = TRACE_ALLOC, rec.ptr = rec.newptr;
+        if (rec.ptr == 0)
+            continue;
+        SLOT(rec.ptr);
+
+        switch (rec.op) {
+            case TRACE_ALLOC:
+                if (keys[h] == rec.ptr && vals[h] != UINT32_MAX)
+                    free_block(vals[h]);     /* missed free of a reused address */
+                id = new_id();
+                block_size[id] = rec.size ? (uint32_t) rec.size : 1;
+                live_bytes += block_size[id];
+                emit(TRACE_ALLOC, id, block_size[id]);
+                if (keys[h] != rec.ptr)
+                    used++;
+                keys[h] = rec.ptr;
+                vals[h] = id;
+                break;
+            case TRACE_FREE:
+                if (keys[h] == rec.ptr && vals[h] != UINT32_MAX) {
+                    free_block(vals[h]);
+                    vals[h] = UINT32_MAX;
+                }
+                break;
+            case TRACE_REALLOC:
+                if (keys[h] != rec.ptr || vals[h] == UINT32_MAX)
+                    break;                   /* block predates the profile */
+                id = vals[h];
+                vals[h] = UINT32_MAX;
+                if (rec.newptr == 0)
+                    break;                   /* failed realloc */
+                if (rec.size == 0) {
+                    free_block(id);
+                    break;
+                }
+                live_bytes = live_bytes - block_size[id] + rec.size;
+                block_size[id] = (uint32_t) rec.size;
+                emit(TRACE_REALLOC, id, block_size[id]);
+                SLOT(rec.newptr);
+                if (keys[h] != rec.newptr)
+                    used++;
+                keys[h] = rec.newptr;
+                vals[h] = id;
+                break;
+        }
+    }
+    fclose(fp);
+
+    /* Balance the trace */
+    for (i = 0; i < slots; i++)
+        if (keys[i] != 0 && vals[i] != UINT32_MAX)
+            free_block(vals[i]);
+#undef SLOT
+    free(keys);
+    free(vals);
+}
+
+/*
+ * parse_dist - parse a distribution spec, see the comment at the top
+ */
+static void parse_dist(char *spec, dist_t *d) {
+    char *p;
+    double v, w, total = 0;
+
+    memset(d, 0, sizeof(*d));
+    if (sscanf(spec, "uniform:%lf:%lf", &d->a, &d->b) == 2) {
+        d->kind = UNIFORM;
+    } else if (sscanf(spec, "exp:%lf", &d->a) == 1) {
+        d->kind = EXPONENTIAL;
+    } else if (sscanf(spec, "lognormal:%lf:%lf", &d->a, &d->b) == 2) {
+        d->kind = LOGNORMAL;
+    } else if (strncmp(spec, "hist:", 5) == 0) {
+        d->kind = HISTOGRAM;
+        for (p = spec + 5; p != NULL && *p; p = strchr(p, ',') ? strchr(p, ',') + 1 : NULL) {
+            if (sscanf(p, "%lf:%lf", &v, &w) != 2 || d->nbuckets == MAXBUCKETS ||
+                (d->nbuckets > 0 && v <= d->bound[d->nbuckets - 1])) {
+                fprintf(stderr, "bad histogram %s\n", spec);
+                exit(1);
+            }
+            total += w;
+            d->bound[d->nbuckets] = v;
+            d->cumw[d->nbuckets++] = total;
+        }
+        if (d->nbuckets == 0 || total <= 0) {
+            fprintf(stderr, "bad histogram %s\n", spec);
+            exit(1);
+        }
+    } else {
+        fprintf(stderr, "bad distribution %s\n", spec);
+        exit(1);
+    }
+}
+
+/*
+ * sample - draw one value from distribution d
+ */
+static double sample(dist_t *d) {
+    double u, lo;
+    int i;
+
+    switch (d->kind) {
+        case UNIFORM:
+            return floor(d->a + urand() * (d->b - d->a + 1));
+        case EXPONENTIAL:
+            return ceil(-d->a * log(1.0 - urand()));
+        case LOGNORMAL:
+            /* Box-Muller */
+            u = sqrt(-2.0 * log(1.0 - urand())) * cos(2.0 * M_PI * urand());
+            return ceil(exp(d->a + d->b * u));
+        case HISTOGRAM:
+            u = urand() * d->cumw[d->nbuckets - 1];
+            for (i = 0; i < d->nbuckets - 1 && u >= d->cumw[i]; i++)
+                ;
+            lo = (i == 0) ? 0 : d->bound[i - 1];
+            return floor(lo + 1 + urand() * (d->bound[i] - lo));
+    }
+    return 1;
+}
+
+/*
+ * urand - uniform double in [0, 1) from a xorshift64* generator, so that
+ *     a seed gives the same trace on every platform
+ */
+static double urand(void) {
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return ((rng_state * 0x2545f4914f6cdd1dULL) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/*
+ * emit - append one request to the trace
+ */
+static void emit(uint32_t type, uint32_t id, uint32_t size) {
+    if (num_ops == max_ops) {
+        max_ops = max_ops ? 2 * max_ops : 1 << 16;
+        ops = (uint32_t *) realloc(ops, max_ops * sizeof(uint32_t));
+        sizes = (uint32_t *) realloc(sizes, max_ops * sizeof(uint32_t));
+        if (ops == NULL || sizes == NULL) {
+            fprintf(stderr, "out of memory\n");
+            exit(1);
+        }
+    }
+    ops[num_ops] = TRACE_OP(type, id);
+    sizes[num_ops++] = size;
+    if (live_bytes > peak_bytes)
+        peak_bytes = live_bytes;
+}
+
+/*
+ * new_id - hand out the next block id
+ */
+static uint32_t new_id(void) {
+    if (num_ids == max_ids) {
+        max_ids = max_ids ? 2 * max_ids : 1 << 16;
+        if ((block_size = (uint32_t *) realloc(block_size,
+                                               max_ids * sizeof(uint32_t))) == NULL) {
+            fprintf(stderr, "out of memory\n");
+            exit(1);
+        }
+    }
+    if (num_ids > TRACE_MAXID) {
+        fprintf(stderr, "too many blocks for the trace format\n");
+        exit(1);
+    }
+    return num_ids++;
+}
+
+/*
+ * free_block - emit the free request of a live block
+ */
+static void free_block(uint32_t id) {
+    live_bytes -= block_size[id];
+    emit(TRACE_FREE, id, 0);
+}
+
+/*
+ * heap_push - schedule the free of block id at step death
+ */
+static void heap_push(uint64_t death, uint32_t id) {
+    long i, parent;
+    event_t ev;
+
+    if (heap_len == heap_max) {
+        heap_max = heap_max ? 2 * heap_max : 1 << 16;
+        if ((heap = (event_t *) realloc(heap, heap_max * sizeof(event_t))) == NULL) {
+            fprintf(stderr, "out of memory\n");
+            exit(1);
+        }
+    }
+    ev.death = death;
+    ev.id = id;
+    for (i = heap_len++; i > 0; i = parent) {
+        parent = (i - 1) / 2;
+        if (heap[parent].death <= death)
+            break;
+        heap[i] = heap[parent];
+    }
+    heap[i] = ev;
+}
+
+/*
+ * heap_pop - remove and return the earliest scheduled free
+ */
+static event_t heap_pop(void) {
+    event_t top = heap[0];
+    event_t last = heap[--heap_len];
+    long i = 0, child;
+
+    while ((child = 2 * i + 1) < heap_len) {
+        if (child + 1 < heap_len && heap[child + 1].death < heap[child].death)
+            child++;
+        if (last.death <= heap[child].death)
+            break;
+        heap[i] = heap[child];
+        i = child;
+    }
+    heap[i] = last;
+    return top;
+}
+
+/*
+ * write_trace - write the trace as a text .rep file or a binary trace
+ */
+static void write_trace(char *path, int binary) {
+    FILE *fp;
+    long i;
+
+    if (binary) {
+        if (write_binary_trace(path, (int) peak_bytes, num_ids, num_ops, 1,
+                               ops, sizes) < 0) {
+            perror(path);
+            exit(1);
+        }
+        return;
+    }
+
+    if ((fp = fopen(path, "w")) == NULL) {
+        perror(path);
+        exit(1);
+    }
+    fprintf(fp, "%d\n%u\n%ld\n%d\n", (int) peak_bytes, num_ids, num_ops, 1);
+    for (i = 0; i < num_ops; i++) {
+        switch (TRACE_OP_TYPE(ops[i])) {
+            case TRACE_ALLOC:
+                fprintf(fp, "a %u %u\n", TRACE_OP_ID(ops[i]), sizes[i]);
+                break;
+            case TRACE_REALLOC:
+                fprintf(fp, "r %u %u\n", TRACE_OP_ID(ops[i]), sizes[i]);
+                break;
+            case TRACE_FREE:
+                fprintf(fp, "f %u\n", TRACE_OP_ID(ops[i]));
+                break;
+        }
+    }
+    if (fclose(fp) != 0) {
+        perror(path);
+        exit(1);
+    }
+}
+
+/*
+ * usage - Explain the command line arguments
+ */
+static void usage(char *prog) {
+    fprintf(stderr, "Usage: %s [-b] [-S <seed>] [-M <KB>] "
+                    "{[-s <dist>] [-l <dist>] [-r <p>:<growth>] -n <allocs>}... -o <file>\n"
+                    "       %s [-b] -R <profile> -o <file>\n", prog, prog);
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-b            Write a binary trace (see tracefmt.h).\n");
+    fprintf(stderr, "\t-l <dist>     Lifetime distribution, in allocations.\n");
+    fprintf(stderr, "\t-M <KB>       Cap on live bytes (default 8192 KB).\n");
+    fprintf(stderr, "\t-n <allocs>   Emit a phase with this many allocations.\n");
+    fprintf(stderr, "\t-o <file>     Output trace file.\n");
+    fprintf(stderr, "\t-r <p>:<g>    Grow a live block by <g> with chance <p> per step.\n");
+    fprintf(stderr, "\t-R <profile>  Convert a libmtrace.so profile instead.\n");
+    fprintf(stderr, "\t-s <dist>     Size distribution, in bytes.\n");
+    fprintf(stderr, "\t-S <seed>     Random seed.\n");
+    fprintf(stderr, "Distributions: uniform:LO:HI exp:MEAN lognormal:MU:SIGMA "
+                    "hist:V1:W1,V2:W2,...\n");
+    exit(1);
+}
@@ -0,0 +1,140 @@
+/*
+ * latency.c - Time single allocator requests and keep their latencies
+ *             in log-bucketed histograms
+ *
+ * The timer is the one of tsc.c: the invariant TSC, fenced as in
+ * tsc_start and tsc_stop, once init_tsc has found and calibrated it,
+ * else CLOCK_MONOTONIC_RAW. Latencies are converted to nanoseconds
+ * with the rate tsc.c measured, since TSC ticks run at a fixed rate
+ * that is not the core clock. The cost of reading the timer twice is
+ * measured once and subtracted from every sample.
+ */
+#include <string.h>
+
+#include "latency.h"
+#include "tsc.h"
+
+#define OVHD_SAMPLES 1000 /* timer reads used to measure its overhead */
+
+static uint64_t overhead = 0; /* ticks of a lat_start, lat_stop pair */
+static double ns_per_tick = 1; /* from the calibrated rate of the timer */
+
+/* function prototypes */
+static int bucket_of(uint64_t v);
+static uint64_t bucket_top(int i);
+
+/*
+ * init_latency - measure the overhead of the timer as the smallest gap
+ *     between two consecutive reads, and take its rate from tsc.c
+ */
+void init_latency(void) {
+    uint64_t t0, t1;
+    int i;
+
+    ns_per_tick = 1e9 / tsc_hz();
+    overhead = ~(uint64_t) 0;
+    for (i = 0; i < OVHD_SAMPLES; i++) {
+        t0 = lat_start();
+        t1 = lat_stop();
+        if (t1 - t0 < overhead)
+            overhead = t1 - t0;
+    }
+}
+
+/*
+ * lat_start - read the timer before a request
+ */
+uint64_t lat_start(void) {
+    return tsc_start();
+}
+
+/*
+ * lat_stop - read the timer after a request
+ */
+uint64_t lat_stop(void) {
+    return tsc_stop();
+}
+
+/*
+ * lat_unit - name the unit of the recorded latencies
+ */
+const char *lat_unit(void) {
+    return "ns";
+}
+
+/*
+ * lat_reset - empty a histogram
+ */
+void lat_reset(lathist_t *h) {
+    memset(h, 0, sizeof(lathist_t));
+}
+
+/*
+ * lat_record - add one request to a histogram, and to its list of
+ *     outliers if it is among the LAT_WORST slowest so far
+ */
+void lat_record(lathist_t *h, uint64_t start, uint64_t end, int opnum) {
+    uint64_t ticks = end - start, ns;
+    int i;
+
+    ticks = ticks > overhead ? ticks - overhead : 0;
+    ns = (uint64_t) (ticks * ns_per_tick + 0.5);
+    h->counts[bucket_of(ns)]++;
+    h->count++;
+    if (ns > h->max)
+        h->max = ns;
+
+    if (ns <= h->worst[LAT_WORST - 1].ns)
+        return;
+    for (i = LAT_WORST - 1; i > 0 && h->worst[i - 1].ns < ns; i--)
+        h->worst[i] = h->worst[i - 1];
+    h->worst[i].ns = ns;
+    h->worst[i].opnum = opnum;
+}
+
+/*
+ * lat_percentile - return the smallest bucket value at or below which
+ *     a fraction q of the recorded requests fall
+ */
+uint64_t lat_percentile(lathist_t *h, double q) {
+    uint64_t rank, seen = 0;
+    uint64_t top;
+    int i;
+
+    if (h->count == 0)
+        return 0;
+    rank = (uint64_t) (q * h->count);
+    if (rank < q * h->count || rank == 0)
+        rank++;
+    for (i = 0; i < LAT_BUCKETS; i++) {
+        seen += h->counts[i];
+        if (seen >= rank)
+            break;
+    }
+    top = bucket_top(i);
+    return top < h->max ? top : h->max;
+}
+
+/*
+ * bucket_of - map a latency to its bucket. Values with their top bit
+ *     at position e >= LAT_SUB_BITS keep their LAT_SUB_BITS+1 leading
+ *     bits, and the rest are dropped.
+ */
+static int bucket_of(uint64_t v) {
+    int shift;
+
+    if (v < LAT_SUB)
+        return (int) v;
+    shift = 63 - __builtin_clzll(v) - LAT_SUB_BITS;
+    return shift * LAT_SUB + (int) (v >> shift);
+}
+
+/*
+ * bucket_top - the largest latency that maps to bucket i
+ */
+static uint64_t bucket_top(int i) {
+    int shift = i < 2 * LAT_SUB ? 0 : i / LAT_SUB - 1;
+    uint64_t lo = (uint64_t) (i - shift * LAT_SUB) << shift;
+
+    return lo + ((uint64_t) 1 << shift) - 1;
+}
@@ -0,0 +1,46 @@
+/*
+ * Per-request latency histograms
+ */
+#include <stdint.h>
+
+/*
+ * Latencies are kept in HDR-style log-linear buckets: values below
+ * LAT_SUB get a bucket each, and every power of two above that is split
+ * into LAT_SUB equal sub-buckets, so any recorded value is known to
+ * within 1/LAT_SUB of itself (about 6%).
+ */
+#define LAT_SUB_BITS 4
+#define LAT_SUB      (1 << LAT_SUB_BITS)
+#define LAT_BUCKETS  ((64 - LAT_SUB_BITS + 1) * LAT_SUB)
+#define LAT_WORST    5  /* slowest requests remembered per histogram */
+
+/* One of the slowest requests recorded in a histogram */
+typedef struct {
+    uint64_t ns;     /* latency of the request */
+    int opnum;       /* index of the request in its trace */
+} lat_outlier_t;
+
+typedef struct {
+    uint64_t counts[LAT_BUCKETS];    /* number of requests per bucket */
+    uint64_t count;                  /* total requests recorded */
+    uint64_t max;                    /* largest latency recorded */
+    lat_outlier_t worst[LAT_WORST];  /* slowest requests, slowest first */
+} lathist_t;
+
+/* Measure the timer overhead; call once after init_fsecs, before lat_start */
+void init_latency(void);
+
+/* Read the timer before and after a request, in ticks of tsc.c's timer */
+uint64_t lat_start(void);
+uint64_t lat_stop(void);
+
+/* Name of the unit of recorded latencies ("ns") */
+const char *lat_unit(void);
+
+void lat_reset(lathist_t *h);
+
+/* Record the request opnum that took from start to end (lat_start and lat_stop values) */
+void lat_record(lathist_t *h, uint64_t start, uint64_t end, int opnum);
+
+/* Return the latency below which a fraction q of the requests fall */
+uint64_t lat_percentile(lathist_t *h, double q);
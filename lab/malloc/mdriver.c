@@ -15,10 +15,20 @@
 #include <assert.h>
 #include <float.h>
 #include <time.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
 
 #include "mm.h"
+#include "slab.h"
+#include "bump.h"
 #include "memlib.h"
 #include "fsecs.h"
+#include "perfctr.h"
+#include "latency.h"
+#include "tracefmt.h"
 #include "config.h"
 
 /**********************
@@ -29,21 +39,35 @@
 #define MAXLINE     1024 /* max string size */
 #define HDRLINES       4 /* number of header lines in a trace file */
 #define LINENUM(i) (i+5) /* cnvt trace request nums to linenums (origin 1) */
+#define MT_RUNS        3 /* best-of runs per thread count in -j mode */
+#define RSS_INTERVAL 100 /* sample the heap RSS every this many requests */
+#define MAP_INTERVAL 1000 /* dump the heap map every this many requests */
+#define RANGE_CHUNK 4096 /* range records carved from each pool chunk */
+#define NUM_OPTYPES    3 /* ALLOC, FREE and REALLOC */
 
 /* Returns true if p is ALIGNMENT-byte aligned */
-#define IS_ALIGNED(p)  ((((unsigned int)(p)) % ALIGNMENT) == 0)
+#define IS_ALIGNED(p)  ((((size_t)(p)) % ALIGNMENT) == 0)
 
 /****************************** 
  * The key compound data types 
  *****************************/
 
-/* Records the extent of each block's payload */
+/* Records the extent of each block's payload, as a node of an AVL tree
+   ordered by lo. Free records are chained through left. */
 typedef struct range_t {
     char *lo;              /* low payload address */
     char *hi;              /* high payload address */
-    struct range_t *next;  /* next list element */
+    struct range_t *left;  /* subtree of lower payloads */
+    struct range_t *right; /* subtree of higher payloads */
+    int height;            /* height of the subtree rooted here */
 } range_t;
 
+/* A chunk of the pool that range records are allocated from */
+typedef struct range_chunk_t {
+    struct range_chunk_t *next;       /* next chunk in the pool */
+    range_t ranges[RANGE_CHUNK];
+} range_chunk_t;
+
 /* Characterizes a single trace operation (allocator request) */
 typedef struct {
     enum {
@@ -64,6 +88,19 @@ typedef struct {
     size_t *block_sizes; /* ... and a corresponding array of payload sizes */
 } trace_t;
 
+/*
+ * An allocator that the -b comparison can replay traces with. start
+ * begins a run on an empty heap; the rest have the libc signatures.
+ */
+typedef struct {
+    char *name;
+    int on_memlib;                         /* allocates from the memlib heap? */
+    int (*start)(void);
+    void *(*malloc)(size_t size);
+    void (*free)(void *ptr);
+    void *(*realloc)(void *ptr, size_t size);
+} backend_t;
+
 /* 
  * Holds the params to the xxx_speed functions, which are timed by fcyc. 
  * This struct is necessary because fcyc accepts only a pointer array
@@ -72,6 +109,7 @@ typedef struct {
 typedef struct {
     trace_t *trace;
     range_t *ranges;
+    backend_t *backend;  /* only used by eval_backend_speed */
 } speed_t;
 
 /* Summarizes the important stats for some malloc function on some trace */
@@ -83,38 +121,117 @@ typedef struct {
 
     /* defined only for the student malloc package */
     double util;     /* space utilization for this trace (always 0 for libc) */
+    double peak_rss; /* largest resident heap size seen during the trace */
+    double final_rss;/* resident heap size once the trace has finished */
+    double tlb_misses;/* dTLB misses during one timed run (-1 if unknown) */
+    int has_internals;/* were mm.c's MM_STATS counters available? */
+    mm_stats_t internals; /* ... and their values after the util run */
+    double frag;     /* mean external fragmentation over the util run */
 
     /* Note: secs and util are only defined if valid is true */
 } stats_t;
 
+/*
+ * Holds the params of one replay thread in the -j scalability mode.
+ * Each thread replays the requests of the block ids assigned to it,
+ * in trace order, after waiting at a common start barrier.
+ */
+typedef struct {
+    trace_t *trace;
+    int *opnums;                 /* indices into trace->ops for this thread */
+    int num_ops;                 /* number of entries in opnums */
+    int use_mm;                  /* replay with mm.c (1) or libc (0) */
+    pthread_barrier_t *barrier;  /* start barrier shared by all threads */
+    struct timeval start, end;   /* when this thread started and finished */
+} replay_t;
+
+/*
+ * Holds a trace prepared for the slab allocator, with one cache per
+ * distinct request size. This struct is also the argument of
+ * eval_slab_speed, which is timed by fsecs.
+ */
+typedef struct {
+    trace_t *trace;
+    int num_sizes;                        /* distinct request sizes... */
+    int sizes[SLAB_MAX_CACHES];           /* ... and the sizes themselves */
+    unsigned char *cls;                   /* per request: its size index */
+    slab_cache_t *caches[SLAB_MAX_CACHES];/* per size index: its cache */
+} slabrun_t;
+
+/* Summarizes one fit policy of the -F sweep over all traces */
+typedef struct {
+    char *policy;    /* value given to MM_FIT */
+    int valid;       /* did every trace run correctly? */
+    double util;     /* mean space utilization */
+    double ops;      /* total number of requests */
+    double secs;     /* total time to run them */
+} fit_t;
+
+/* Summarizes one thread count of the -j scalability sweep for one trace */
+typedef struct {
+    int threads;     /* number of replay threads */
+    double mm_secs;  /* best time for the mm package */
+    double libc_secs;/* best time for libc malloc */
+} scale_t;
+
 /********************
  * Global variables
  *******************/
 int verbose = 0;        /* global flag for verbose output */
 static int errors = 0;  /* number of errs found when running student malloc */
+static int check_heap = 0; /* run mm_check after every request (-C) */
 char msg[MAXLINE];      /* for whenever we need to compose an error message */
 
 /* Directory where default tracefiles are found */
 static char tracedir[MAXLINE] = TRACEDIR;
 
+/* Pool of range records: all chunks, unused records, and the fill
+   level of the newest chunk */
+static range_chunk_t *range_chunks = NULL;
+static range_t *range_freelist = NULL;
+static int range_chunk_used = RANGE_CHUNK;
+
+/* The mm.c fit policies compared by the -F sweep */
+static char *fit_policies[] = {
+        "first", "next", "best", "good", NULL
+};
+
+/* Serializes calls into mm.c, which is not thread safe, in -j mode */
+static pthread_mutex_t mm_lock = PTHREAD_MUTEX_INITIALIZER;
+
 /* The filenames of the default tracefiles */
 static char *default_tracefiles[] = {
         DEFAULT_TRACEFILES, NULL
 };
 
+/* The filenames of the tracefiles used by default in -s mode */
+static char *slab_tracefiles[] = {
+        SLAB_TRACEFILES, NULL
+};
+
 
 /********************* 
  * Function prototypes 
  *********************/
 
-/* these functions manipulate range lists */
+/* these functions manipulate range trees */
 static int add_range(range_t **ranges, char *lo, int size,
                      int tracenum, int opnum);
 static void remove_range(range_t **ranges, char *lo);
 static void clear_ranges(range_t **ranges);
+static range_t *alloc_range(void);
+static range_t *insert_range(range_t *root, range_t *p);
+static range_t *delete_range(range_t *root, char *lo, range_t **removed);
+static range_t *balance_range(range_t *p);
+static range_t *rotate_left(range_t *p);
+static range_t *rotate_right(range_t *p);
+static void fix_height(range_t *p);
 
 /* These functions read, allocate, and free storage for traces */
 static trace_t *read_trace(char *tracedir, char *filename);
+static trace_t *read_text_trace(FILE *tracefile, char *path);
+static trace_t *read_binary_trace(char *path);
+static trace_t *alloc_trace(int num_ids, int num_ops);
 static void free_trace(trace_t *trace);
 
 /* Routines for evaluating the correctness and speed of libc malloc */
@@ -124,11 +241,39 @@ static void eval_libc_speed(void *ptr);
 /* Routines for evaluating correctnes, space utilization, and speed 
    of the student's malloc package in mm.c */
 static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges);
-static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges);
+static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges,
+                           stats_t *stats, FILE *rssfile, FILE *mapfile);
 static void eval_mm_speed(void *ptr);
+static void eval_mm_latency(trace_t *trace, lathist_t *hists);
+
+/* Routines for the multithreaded scalability sweep (-j) */
+static void *replay_thread(void *vargp);
+static double eval_mt_speed(trace_t *trace, int nthreads, int use_mm);
+static void eval_fit_sweep(char **tracefiles, int num_tracefiles);
+static int mm_start(void);
+static int libc_start(void);
+static int bump_start(void);
+static void eval_backends(char **tracefiles, int num_tracefiles);
+static int eval_backend_valid(backend_t *b, trace_t *trace, int tracenum,
+                              range_t **ranges);
+static double eval_backend_util(backend_t *b, trace_t *trace);
+static void eval_backend_speed(void *ptr);
+
+/* these functions run the slab allocator on a trace */
+static int slab_classify(trace_t *trace, slabrun_t *run);
+static void slab_start(slabrun_t *run);
+static int eval_slab_valid(slabrun_t *run, int tracenum, range_t **ranges);
+static double eval_slab_util(slabrun_t *run);
+static void eval_slab_speed(void *ptr);
+static void eval_scalability(trace_t *trace, int tracenum, int max_threads,
+                             FILE *csvfile);
 
 /* Various helper routines */
 static void printresults(int n, stats_t *stats);
+static void printfootprint(int n, stats_t *stats);
+static void printlatency(int n, lathist_t *lat_stats);
+static void printinternals(int n, stats_t *stats);
+static void printslab(int n, stats_t *mm_stats, stats_t *slab_stats);
 static void usage(void);
 static void unix_error(char *msg);
 static void malloc_error(int tracenum, int opnum, char *msg);
@@ -146,11 +291,24 @@ int main(int argc, char **argv) {
     range_t *ranges = NULL;    /* keeps track of block extents for one trace */
     stats_t *libc_stats = NULL;/* libc stats for each trace */
     stats_t *mm_stats = NULL;  /* mm (i.e. student) stats for each trace */
+    lathist_t *lat_stats = NULL;/* mm latencies per trace and request type */
+    mm_stats_t internals;      /* probes for mm.c's MM_STATS counters */
     speed_t speed_params;      /* input parameters to the xx_speed routines */
 
     int team_check = 1;  /* If set, check team structure (reset by -a) */
     int run_libc = 0;    /* If set, run libc malloc (set by -l) */
     int autograder = 0;  /* If set, emit summary info for autograder (-g) */
+    int max_threads = 0; /* If set, run the scalability sweep (-j) */
+    FILE *csvfile = NULL;/* If set, scalability results go here as CSV (-c) */
+    FILE *rssfile = NULL;/* If set, RSS samples go here as CSV (-r) */
+    FILE *mapfile = NULL;/* If set, heap maps go here as CSV (-m) */
+    int count_tlb = 0;   /* If set, count dTLB misses of mm malloc (-T) */
+    int time_ops = 0;    /* If set, time each mm request (-L) */
+    int fit_sweep = 0;   /* If set, compare the mm.c fit policies (-F) */
+    int run_slab = 0;    /* If set, compare slab.c with mm malloc (-s) */
+    int run_backends = 0;/* If set, compare all allocator backends (-b) */
+    stats_t *slab_stats = NULL;/* slab allocator stats for each trace */
+    slabrun_t slab_params;     /* input parameters to eval_slab_speed */
 
     /* temporaries used to compute the performance index */
     double secs, ops, util, avg_mm_util, avg_mm_throughput, p1, p2, perfindex;
@@ -159,7 +317,7 @@ int main(int argc, char **argv) {
     /* 
      * Read and interpret the command line arguments 
      */
-    while ((c = getopt(argc, argv, "f:t:hvVgal")) != EOF) {
+    while ((c = getopt(argc, argv, "f:t:c:j:m:r:hvVgabslCTLF")) != EOF) {
         switch (c) {
             case 'g': /* Generate summary info for the autograder */
                 autograder = 1;
@@ -185,6 +343,44 @@ int main(int argc, char **argv) {
             case 'l': /* Run libc malloc */
                 run_libc = 1;
                 break;
+            case 'j': /* Replay traces on up to n threads */
+                if ((max_threads = atoi(optarg)) < 1) {
+                    usage();
+                    exit(1);
+                }
+                break;
+            case 'c': /* Write scalability results as CSV */
+                if ((csvfile = fopen(optarg, "w")) == NULL)
+                    unix_error("ERROR: could not open CSV file");
+                break;
+            case 'r': /* Write the heap RSS over time as CSV */
+                if ((rssfile = fopen(optarg, "w")) == NULL)
+                    unix_error("ERROR: could not open RSS file");
+                fprintf(rssfile, "trace,op,footprint,rss,frag\n");
+                break;
+            case 'm': /* Write periodic heap maps as CSV */
+                if ((mapfile = fopen(optarg, "w")) == NULL)
+                    unix_error("ERROR: could not open heap map file");
+                fprintf(mapfile, "trace,op,offset,size,alloc\n");
+                break;
+            case 'T': /* Count dTLB misses with perf_event_open */
+                count_tlb = 1;
+                break;
+            case 's': /* Compare the slab allocator with mm malloc */
+                run_slab = 1;
+                break;
+            case 'b': /* Compare mm malloc with the other backends */
+                run_backends = 1;
+                break;
+            case 'C': /* Check the mm heap after every request */
+                check_heap = 1;
+                break;
+            case 'F': /* Run every trace under every fit policy */
+                fit_sweep = 1;
+                break;
+            case 'L': /* Report per-request latency percentiles */
+                time_ops = 1;
+                break;
             case 'v': /* Print per-trace performance breakdown */
                 verbose = 1;
                 break;
@@ -228,7 +424,11 @@ int main(int argc, char **argv) {
      * If no -f command line arg, then use the entire set of tracefiles 
      * defined in default_traces[]
      */
-    if (tracefiles == NULL) {
+    if (tracefiles == NULL && run_slab) {
+        tracefiles = slab_tracefiles;
+        num_tracefiles = sizeof(slab_tracefiles) / sizeof(char *) - 1;
+        printf("Using slab tracefiles in %s\n", tracedir);
+    } else if (tracefiles == NULL) {
         tracefiles = default_tracefiles;
         num_tracefiles = sizeof(default_tracefiles) / sizeof(char *) - 1;
         printf("Using default tracefiles in %s\n", tracedir);
@@ -236,6 +436,10 @@ int main(int argc, char **argv) {
 
     /* Initialize the timing package */
     init_fsecs();
+    if (count_tlb && init_perfctr() < 0)
+        count_tlb = 0;
+    if (time_ops)
+        init_latency();
 
     /*
      * Optionally run and evaluate the libc malloc package 
@@ -282,6 +486,12 @@ int main(int argc, char **argv) {
     mm_stats = (stats_t *) calloc(num_tracefiles, sizeof(stats_t));
     if (mm_stats == NULL)
         unix_error("mm_stats calloc in main failed");
+    if (time_ops) {
+        lat_stats = (lathist_t *) calloc(num_tracefiles * NUM_OPTYPES,
+                                         sizeof(lathist_t));
+        if (lat_stats == NULL)
+            unix_error("lat_stats calloc in main failed");
+    }
 
     /* Initialize the simulated memory system in memlib.c */
     mem_init();
@@ -296,23 +506,101 @@ int main(int argc, char **argv) {
         if (mm_stats[i].valid) {
             if (verbose > 1)
                 printf("efficiency, ");
-            mm_stats[i].util = eval_mm_util(trace, i, &ranges);
+            mm_stats[i].util = eval_mm_util(trace, i, &ranges, &mm_stats[i],
+                                            rssfile, mapfile);
             speed_params.trace = trace;
             speed_params.ranges = ranges;
             if (verbose > 1)
                 printf("and performance.\n");
             mm_stats[i].secs = fsecs(eval_mm_speed, &speed_params);
+            mm_stats[i].tlb_misses = count_tlb ?
+                    perfctr_dtlb_misses(eval_mm_speed, &speed_params) : -1;
+            if (time_ops)
+                eval_mm_latency(trace, &lat_stats[i * NUM_OPTYPES]);
         }
         free_trace(trace);
     }
+    if (rssfile)
+        fclose(rssfile);
+    if (mapfile)
+        fclose(mapfile);
 
     /* Display the mm results in a compact table */
     if (verbose) {
         printf("\nResults for mm malloc:\n");
         printresults(num_tracefiles, mm_stats);
+        printf("\nMemory footprint for mm malloc:\n");
+        printfootprint(num_tracefiles, mm_stats);
+        printf("\n");
+        if (mm_get_stats(&internals) == 0) {
+            printf("Internals of mm malloc (MM_STATS):\n");
+            printinternals(num_tracefiles, mm_stats);
+            printf("\n");
+        }
+    }
+    if (time_ops)
+        printlatency(num_tracefiles, lat_stats);
+
+    /*
+     * Optionally run the slab allocator on the traces it can serve
+     */
+    if (run_slab) {
+        slab_stats = (stats_t *) calloc(num_tracefiles, sizeof(stats_t));
+        if (slab_stats == NULL)
+            unix_error("slab_stats calloc in main failed");
+        for (i = 0; i < num_tracefiles; i++) {
+            trace = read_trace(tracedir, tracefiles[i]);
+            slab_stats[i].ops = trace->num_ops;
+            if (slab_classify(trace, &slab_params)) {
+                slab_stats[i].valid = eval_slab_valid(&slab_params, i, &ranges);
+                if (slab_stats[i].valid) {
+                    slab_stats[i].util = eval_slab_util(&slab_params);
+                    slab_stats[i].secs = fsecs(eval_slab_speed, &slab_params);
+                }
+                free(slab_params.cls);
+            }
+            free_trace(trace);
+        }
+        printf("\nSlab allocator vs mm malloc:\n");
+        printslab(num_tracefiles, mm_stats, slab_stats);
         printf("\n");
     }
 
+    /*
+     * Optionally compare the fit policies of mm.c on all traces
+     */
+    if (fit_sweep)
+        eval_fit_sweep(tracefiles, num_tracefiles);
+
+    /*
+     * Optionally compare mm malloc with the other allocator backends
+     */
+    if (run_backends)
+        eval_backends(tracefiles, num_tracefiles);
+
+    /*
+     * Optionally measure how mm and libc malloc scale with threads
+     */
+    if (max_threads > 0) {
+        /* The timing package pinned us to one CPU; the threads need them all */
+        unpin_fsecs();
+        printf("\nScalability (trace ids partitioned across threads, best of %d):\n",
+               MT_RUNS);
+        printf("%5s%8s%10s%6s%10s%6s\n",
+               "trace", "threads", "mm Kops", "eff", "libc Kops", "eff");
+        if (csvfile)
+            fprintf(csvfile, "trace,threads,allocator,ops,secs,kops,speedup,efficiency\n");
+        for (i = 0; i < num_tracefiles; i++) {
+            if (!mm_stats[i].valid)
+                continue;
+            trace = read_trace(tracedir, tracefiles[i]);
+            eval_scalability(trace, i, max_threads, csvfile);
+            free_trace(trace);
+        }
+        if (csvfile)
+            fclose(csvfile);
+    }
+
     /* 
      * Accumulate the aggregate statistics for the student's mm package 
      */
@@ -364,21 +652,24 @@ int main(int argc, char **argv) {
 
 
 /*****************************************************************
- * The following routines manipulate the range list, which keeps 
- * track of the extent of every allocated block payload. We use the 
- * range list to detect any overlapping allocated blocks.
+ * The following routines manipulate the range tree, which keeps
+ * track of the extent of every allocated block payload. We use the
+ * range tree to detect any overlapping allocated blocks. Since the
+ * payloads in the tree never overlap, a new payload overlaps some
+ * payload iff it overlaps the one with the greatest lo <= its hi,
+ * so every check, insertion and removal is O(log n).
  ****************************************************************/
 
 /*
  * add_range - As directed by request opnum in trace tracenum,
  *     we've just called the student's mm_malloc to allocate a block of 
  *     size bytes at addr lo. After checking the block for correctness,
- *     we create a range struct for this block and add it to the range list. 
+ *     we create a range struct for this block and add it to the range tree.
  */
 static int add_range(range_t **ranges, char *lo, int size,
                      int tracenum, int opnum) {
     char *hi = lo + size - 1;
-    range_t *p;
+    range_t *p, *pred;
     char msg[MAXLINE];
 
     assert(size > 0);
@@ -391,9 +682,8 @@ static int add_range(range_t **ranges, char *lo, int size,
         return 0;
     }
 
-    /* The payload must lie within the extent of the heap */
-    if ((lo < (char *) mem_heap_lo()) || (lo > (char *) mem_heap_hi()) ||
-        (hi < (char *) mem_heap_lo()) || (hi > (char *) mem_heap_hi())) {
+    /* The payload must lie within the heap or a single memlib mapping */
+    if (!mem_owns(lo, hi)) {
         sprintf(msg, "Payload (%p:%p) lies outside heap (%p:%p)",
                 lo, hi, mem_heap_lo(), mem_heap_hi());
         malloc_error(tracenum, opnum, msg);
@@ -401,26 +691,29 @@ static int add_range(range_t **ranges, char *lo, int size,
     }
 
     /* The payload must not overlap any other payloads */
-    for (p = *ranges; p != NULL; p = p->next) {
-        if ((lo >= p->lo && lo <= p->hi) ||
-            (hi >= p->lo && hi <= p->hi)) {
-            sprintf(msg, "Payload (%p:%p) overlaps another payload (%p:%p)\n",
-                    lo, hi, p->lo, p->hi);
-            malloc_error(tracenum, opnum, msg);
-            return 0;
-        }
+    pred = NULL;
+    for (p = *ranges; p != NULL; ) {
+        if (p->lo <= hi) {
+            pred = p;
+            p = p->right;
+        } else
+            p = p->left;
+    }
+    if (pred != NULL && pred->hi >= lo) {
+        sprintf(msg, "Payload (%p:%p) overlaps another payload (%p:%p)\n",
+                lo, hi, pred->lo, pred->hi);
+        malloc_error(tracenum, opnum, msg);
+        return 0;
     }
 
     /* 
      * Everything looks OK, so remember the extent of this block 
-     * by creating a range struct and adding it the range list.
+     * by creating a range struct and adding it the range tree.
      */
-    if ((p = (range_t *) malloc(sizeof(range_t))) == NULL)
-        unix_error("malloc error in add_range");
-    p->next = *ranges;
+    p = alloc_range();
     p->lo = lo;
     p->hi = hi;
-    *ranges = p;
+    *ranges = insert_range(*ranges, p);
     return 1;
 }
 
@@ -428,18 +721,12 @@ static int add_range(range_t **ranges, char *lo, int size,
  * remove_range - Free the range record of block whose payload starts at lo 
  */
 static void remove_range(range_t **ranges, char *lo) {
-    range_t *p;
-    range_t **prevpp = ranges;
-    int size;
+    range_t *p = NULL;
 
-    for (p = *ranges; p != NULL; p = p->next) {
-        if (p->lo == lo) {
-            *prevpp = p->next;
-            size = p->hi - p->lo + 1;
-            free(p);
-            break;
-        }
-        prevpp = &(p->next);
+    *ranges = delete_range(*ranges, lo, &p);
+    if (p != NULL) {
+        p->left = range_freelist;
+        range_freelist = p;
     }
 }
 
@@ -447,51 +734,196 @@ static void remove_range(range_t **ranges, char *lo) {
  * clear_ranges - free all of the range records for a trace 
  */
 static void clear_ranges(range_t **ranges) {
-    range_t *p;
-    range_t *pnext;
+    range_chunk_t *c;
+    range_chunk_t *cnext;
 
-    for (p = *ranges; p != NULL; p = pnext) {
-        pnext = p->next;
-        free(p);
+    for (c = range_chunks; c != NULL; c = cnext) {
+        cnext = c->next;
+        free(c);
     }
+    range_chunks = NULL;
+    range_freelist = NULL;
+    range_chunk_used = RANGE_CHUNK;
     *ranges = NULL;
 }
 
+/*
+ * alloc_range - take a range record from the pool, growing it by a
+ *     chunk of RANGE_CHUNK records when it runs dry
+ */
+static range_t *alloc_range(void) {
+    range_chunk_t *c;
+    range_t *p;
+
+    if ((p = range_freelist) != NULL) {
+        range_freelist = p->left;
+    } else {
+        if (range_chunk_used == RANGE_CHUNK) {
+            if ((c = (range_chunk_t *) malloc(sizeof(range_chunk_t))) == NULL)
+                unix_error("malloc error in add_range");
+            c->next = range_chunks;
+            range_chunks = c;
+            range_chunk_used = 0;
+        }
+        p = &range_chunks->ranges[range_chunk_used++];
+    }
+    p->left = p->right = NULL;
+    p->height = 1;
+    return p;
+}
+
+#define RANGE_HEIGHT(p) ((p) ? (p)->height : 0)
+
+/*
+ * fix_height - recompute the height of p from its children
+ */
+static void fix_height(range_t *p) {
+    int lh = RANGE_HEIGHT(p->left);
+    int rh = RANGE_HEIGHT(p->right);
+    p->height = 1 + (lh > rh ? lh : rh);
+}
+
+/*
+ * rotate_right, rotate_left - single rotations about p; return the
+ *     new subtree root
+ */
+static range_t *rotate_right(range_t *p) {
+    range_t *q = p->left;
+    p->left = q->right;
+    q->right = p;
+    fix_height(p);
+    fix_height(q);
+    return q;
+}
+
+static range_t *rotate_left(range_t *p) {
+    range_t *q = p->right;
+    p->right = q->left;
+    q->left = p;
+    fix_height(p);
+    fix_height(q);
+    return q;
+}
+
+/*
+ * balance_range - restore the AVL property at p after one of its
+ *     subtrees changed height by one; return the new subtree root
+ */
+static range_t *balance_range(range_t *p) {
+    int lh = RANGE_HEIGHT(p->left);
+    int rh = RANGE_HEIGHT(p->right);
+
+    if (lh > rh + 1) {
+        if (RANGE_HEIGHT(p->left->left) < RANGE_HEIGHT(p->left->right))
+            p->left = rotate_left(p->left);
+        return rotate_right(p);
+    }
+    if (rh > lh + 1) {
+        if (RANGE_HEIGHT(p->right->right) < RANGE_HEIGHT(p->right->left))
+            p->right = rotate_right(p->right);
+        return rotate_left(p);
+    }
+    fix_height(p);
+    return p;
+}
+
+/*
+ * insert_range - insert record p into the tree rooted at root
+ */
+static range_t *insert_range(range_t *root, range_t *p) {
+    if (root == NULL)
+        return p;
+    if (p->lo < root->lo)
+        root->left = insert_range(root->left, p);
+    else
+        root->right = insert_range(root->right, p);
+    return balance_range(root);
+}
+
+/*
+ * delete_range - unlink the record whose payload starts at lo from the
+ *     tree rooted at root, and hand it back through *removed
+ */
+static range_t *delete_range(range_t *root, char *lo, range_t **removed) {
+    range_t *min, *succ;
+
+    if (root == NULL)
+        return NULL;
+    if (lo < root->lo) {
+        root->left = delete_range(root->left, lo, removed);
+    } else if (lo > root->lo) {
+        root->right = delete_range(root->right, lo, removed);
+    } else {
+        *removed = root;
+        if (root->left == NULL)
+            return root->right;
+        if (root->right == NULL)
+            return root->left;
+        /* Replace root by the lowest record of its right subtree */
+        for (min = root->right; min->left != NULL; min = min->left)
+            ;
+        min->right = delete_range(root->right, min->lo, &succ);
+        min->left = root->left;
+        root = min;
+    }
+    return balance_range(root);
+}
+
 
 /**********************************************
  * The following routines manipulate tracefiles
  *********************************************/
 
 /*
- * read_trace - read a trace file and store it in memory
+ * read_trace - read a trace file and store it in memory. Binary traces
+ *     (see tracefmt.h) are recognized by their magic number and mapped;
+ *     anything else is parsed as a text .rep file.
  */
 static trace_t *read_trace(char *tracedir, char *filename) {
     FILE *tracefile;
     trace_t *trace;
-    char type[MAXLINE];
     char path[MAXLINE];
-    unsigned index, size;
-    unsigned max_index = 0;
-    unsigned op_index;
+    uint32_t magic = 0;
+    struct timeval stv, etv;
 
     if (verbose > 1)
         printf("Reading tracefile: %s\n", filename);
+    gettimeofday(&stv, NULL);
 
-    /* Allocate the trace record */
-    if ((trace = (trace_t *) malloc(sizeof(trace_t))) == NULL)
-        unix_error("malloc 1 failed in read_trance");
-
-    /* Read the trace file header */
     strcpy(path, tracedir);
     strcat(path, filename);
     if ((tracefile = fopen(path, "r")) == NULL) {
         sprintf(msg, "Could not open %s in read_trace", path);
         unix_error(msg);
     }
-    fscanf(tracefile, "%d", &(trace->sugg_heapsize)); /* not used */
-    fscanf(tracefile, "%d", &(trace->num_ids));
-    fscanf(tracefile, "%d", &(trace->num_ops));
-    fscanf(tracefile, "%d", &(trace->weight));        /* not used */
+    if (fread(&magic, sizeof(magic), 1, tracefile) == 1 && magic == TRACE_MAGIC) {
+        fclose(tracefile);
+        trace = read_binary_trace(path);
+    } else {
+        rewind(tracefile);
+        trace = read_text_trace(tracefile, path);
+        fclose(tracefile);
+    }
+
+    gettimeofday(&etv, NULL);
+    if (verbose > 1)
+        printf("Loaded %d ops in %.6f secs\n", trace->num_ops,
+               (etv.tv_sec - stv.tv_sec) + 1E-6 * (etv.tv_usec - stv.tv_usec));
+    return trace;
+}
+
+/*
+ * alloc_trace - allocate a trace record and the three arrays it points
+ *     to, sized for num_ops requests on num_ids blocks
+ */
+static trace_t *alloc_trace(int num_ids, int num_ops) {
+    trace_t *trace;
+
+    /* Allocate the trace record */
+    if ((trace = (trace_t *) malloc(sizeof(trace_t))) == NULL)
+        unix_error("malloc 1 failed in read_trance");
+    trace->num_ids = num_ids;
+    trace->num_ops = num_ops;
 
     /* We'll store each request line in the trace in this array */
     if ((trace->ops =
@@ -508,6 +940,29 @@ static trace_t *read_trace(char *tracedir, char *filename) {
                  (size_t *) malloc(trace->num_ids * sizeof(size_t))) == NULL)
         unix_error("malloc 4 failed in read_trace");
 
+    return trace;
+}
+
+/*
+ * read_text_trace - parse a text .rep trace file
+ */
+static trace_t *read_text_trace(FILE *tracefile, char *path) {
+    trace_t *trace;
+    char type[MAXLINE];
+    unsigned index, size;
+    unsigned max_index = 0;
+    unsigned op_index;
+    int sugg_heapsize, num_ids, num_ops, weight;
+
+    /* Read the trace file header */
+    fscanf(tracefile, "%d", &sugg_heapsize); /* not used */
+    fscanf(tracefile, "%d", &num_ids);
+    fscanf(tracefile, "%d", &num_ops);
+    fscanf(tracefile, "%d", &weight);        /* not used */
+    trace = alloc_trace(num_ids, num_ops);
+    trace->sugg_heapsize = sugg_heapsize;
+    trace->weight = weight;
+
     /* read every request line in the trace file */
     index = 0;
     op_index = 0;
@@ -540,13 +995,93 @@ static trace_t *read_trace(char *tracedir, char *filename) {
         op_index++;
 
     }
-    fclose(tracefile);
     assert(max_index == trace->num_ids - 1);
     assert(trace->num_ops == op_index);
 
     return trace;
 }
 
+/*
+ * read_binary_trace - map a binary trace file and decode its op
+ *     records and varint size stream into a new trace in a single pass
+ */
+static trace_t *read_binary_trace(char *path) {
+    int fd;
+    struct stat st;
+    char *base;
+    tracehdr_t *hdr;
+    const uint32_t *recs;
+    const unsigned char *sizep, *sizes_end;
+    trace_t *trace;
+    uint32_t op, size;
+    int i;
+
+    if ((fd = open(path, O_RDONLY)) < 0 || fstat(fd, &st) < 0) {
+        sprintf(msg, "Could not open %s in read_binary_trace", path);
+        unix_error(msg);
+    }
+    base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+    if (base == MAP_FAILED)
+        unix_error("mmap failed in read_binary_trace");
+    close(fd);
+
+    /* Check that the header describes the file we mapped */
+    hdr = (tracehdr_t *) base;
+    if (st.st_size < sizeof(tracehdr_t) || hdr->version != TRACE_VERSION ||
+        hdr->num_ops < 0 || hdr->num_ids < 0 ||
+        (uint64_t) hdr->num_ops > SIZE_MAX / sizeof(traceop_t) ||
+        (uint64_t) hdr->num_ids > SIZE_MAX / sizeof(size_t) ||
+        hdr->sizes_bytes > (uint64_t) st.st_size ||
+        (uint64_t) sizeof(tracehdr_t) + (uint64_t) hdr->num_ops * sizeof(uint32_t)
+        + hdr->sizes_bytes != (uint64_t) st.st_size) {
+        printf("Malformed binary tracefile %s\n", path);
+        exit(1);
+    }
+
+    trace = alloc_trace(hdr->num_ids, hdr->num_ops);
+    trace->sugg_heapsize = hdr->sugg_heapsize;
+    trace->weight = hdr->weight;
+    recs = (const uint32_t *) (base + sizeof(tracehdr_t));
+    sizep = (const unsigned char *) (recs + hdr->num_ops);
+    sizes_end = sizep + hdr->sizes_bytes;
+
+    for (i = 0; i < trace->num_ops; i++) {
+        op = recs[i];
+        trace->ops[i].index = TRACE_OP_ID(op);
+        if (trace->ops[i].index >= trace->num_ids) {
+            printf("Bad block id on request %d in tracefile %s\n", i, path);
+            exit(1);
+        }
+        switch (TRACE_OP_TYPE(op)) {
+            case TRACE_ALLOC:
+                trace->ops[i].type = ALLOC;
+                break;
+            case TRACE_REALLOC:
+                trace->ops[i].type = REALLOC;
+                break;
+            case TRACE_FREE:
+                trace->ops[i].type = FREE;
+                continue;
+            default:
+                printf("Bogus request type on request %d in tracefile %s\n",
+                       i, path);
+                exit(1);
+        }
+        if ((sizep = varint_decode(sizep, sizes_end, &size)) == NULL) {
+            printf("Truncated or malformed size stream in tracefile %s\n", path);
+            exit(1);
+        }
+        trace->ops[i].size = size;
+    }
+    if (sizep != sizes_end) {
+        printf("Trailing bytes after the size stream in tracefile %s\n", path);
+        exit(1);
+    }
+
+    munmap(base, st.st_size);
+    return trace;
+}
+
 /*
  * free_trace - Free the trace record and the three arrays it points
  *              to, all of which were allocated in read_trace().
@@ -644,7 +1179,7 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges) {
                 oldsize = trace->block_sizes[index];
                 if (size < oldsize) oldsize = size;
                 for (j = 0; j < oldsize; j++) {
-                    if (newp[j] != (index & 0xFF)) {
+                    if ((unsigned char) newp[j] != (index & 0xFF)) {
                         malloc_error(tracenum, i, "mm_realloc did not preserve the "
                                                   "data from old block");
                         return 0;
@@ -669,6 +1204,11 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges) {
                 app_error("Nonexistent request type in eval_mm_valid");
         }
 
+        /* Optionally check the whole heap after the request */
+        if (check_heap && mm_check() != 0) {
+            malloc_error(tracenum, i, "mm_check found an inconsistent heap.");
+            return 0;
+        }
     }
 
     /* As far as we know, this is a valid malloc package */
@@ -680,13 +1220,17 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges) {
  *   The idea is to remember the high water mark "hwm" of the heap for 
  *   an optimal allocator, i.e., no gaps and no internal fragmentation.
  *   Utilization is the ratio hwm/heapsize, where heapsize is the 
- *   size of the heap in bytes after running the student's malloc 
- *   package on the trace. Note that our implementation of mem_sbrk() 
- *   doesn't allow the students to decrement the brk pointer, so brk
- *   is always the high water mark of the heap. 
- *   
+ *   high water mark of the heap plus any memlib mappings while running
+ *   the student's malloc package on the trace. Since mem_sbrk() lets
+ *   the students decrement the brk pointer, memlib tracks that high
+ *   water mark for us. Along the way we sample the resident size of
+ *   the heap every RSS_INTERVAL requests, and log it to rssfile if set,
+ *   and dump the heap map to mapfile, if set, every MAP_INTERVAL requests.
+ *   If mm.c keeps MM_STATS counters, we also average the external
+ *   fragmentation over the samples and collect the counters at the end.
  */
-static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges) {
+static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges,
+                           stats_t *stats, FILE *rssfile, FILE *mapfile) {
     int i;
     int index;
     int size, newsize, oldsize;
@@ -694,13 +1238,31 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges) {
     int total_size = 0;
     char *p;
     char *newp, *oldp;
+    double rss, frag;
+    int nsamples = 0;
 
     /* initialize the heap and the mm malloc package */
     mem_reset_brk();
     if (mm_init() < 0)
         app_error("mm_init failed in eval_mm_util");
+    stats->peak_rss = 0;
+    stats->frag = 0;
+    stats->has_internals = (mm_get_stats(&stats->internals) == 0);
 
     for (i = 0; i < trace->num_ops; i++) {
+        if (i % RSS_INTERVAL == 0) {
+            rss = mem_rss();
+            stats->peak_rss = (rss > stats->peak_rss) ? rss : stats->peak_rss;
+            frag = (rssfile || stats->has_internals) ? mm_frag() : 0;
+            stats->frag += frag;
+            nsamples++;
+            if (rssfile)
+                fprintf(rssfile, "%d,%d,%lu,%.0f,%.4f\n", tracenum, i,
+                        (unsigned long) mem_footprint(), rss, frag);
+        }
+        if (mapfile && i % MAP_INTERVAL == 0)
+            mm_heapmap(mapfile, tracenum, i);
+
         switch (trace->ops[i].type) {
 
             case ALLOC: /* mm_alloc */
@@ -764,7 +1326,20 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges) {
         }
     }
 
-    return ((double) max_total_size / (double) mem_heapsize());
+    stats->final_rss = mem_rss();
+    if (stats->final_rss > stats->peak_rss)
+        stats->peak_rss = stats->final_rss;
+    if (rssfile)
+        fprintf(rssfile, "%d,%d,%lu,%.0f,%.4f\n", tracenum, trace->num_ops,
+                (unsigned long) mem_footprint(), stats->final_rss, mm_frag());
+    if (mapfile)
+        mm_heapmap(mapfile, tracenum, trace->num_ops);
+    if (nsamples > 0)
+        stats->frag /= nsamples;
+    if (stats->has_internals)
+        mm_get_stats(&stats->internals);
+
+    return ((double) max_total_size / (double) mem_peak_footprint());
 }
 
 
@@ -814,6 +1389,62 @@ static void eval_mm_speed(void *ptr) {
         }
 }
 
+/*
+ * eval_mm_latency - Replay the trace once more with the mm malloc
+ *    package, timing every request on its own. Request latencies go
+ *    into hists[ALLOC], hists[FREE] and hists[REALLOC]. This is a
+ *    separate run from eval_mm_speed so that reading the timer does
+ *    not perturb the throughput numbers.
+ */
+static void eval_mm_latency(trace_t *trace, lathist_t *hists) {
+    int i, index;
+    char *p;
+    uint64_t start, end;
+
+    for (i = 0; i < NUM_OPTYPES; i++)
+        lat_reset(&hists[i]);
+
+    /* Reset the heap and initialize the mm package */
+    mem_reset_brk();
+    if (mm_init() < 0)
+        app_error("mm_init failed in eval_mm_latency");
+
+    /* Interpret each trace request */
+    for (i = 0; i < trace->num_ops; i++) {
+        index = trace->ops[i].index;
+        switch (trace->ops[i].type) {
+
+            case ALLOC: /* mm_malloc */
+                start = lat_start();
+                p = mm_malloc(trace->ops[i].size);
+                end = lat_stop();
+                if (p == NULL)
+                    app_error("mm_malloc error in eval_mm_latency");
+                trace->blocks[index] = p;
+                break;
+
+            case REALLOC: /* mm_realloc */
+                start = lat_start();
+                p = mm_realloc(trace->blocks[index], trace->ops[i].size);
+                end = lat_stop();
+                if (p == NULL)
+                    app_error("mm_realloc error in eval_mm_latency");
+                trace->blocks[index] = p;
+                break;
+
+            case FREE: /* mm_free */
+                start = lat_start();
+                mm_free(trace->blocks[index]);
+                end = lat_stop();
+                break;
+
+            default:
+                app_error("Nonexistent request type in eval_mm_latency");
+        }
+        lat_record(&hists[trace->ops[i].type], start, end, i);
+    }
+}
+
 /*
  * eval_libc_valid - We run this function to make sure that the
  *    libc malloc can run to completion on the set of traces.
@@ -897,6 +1528,664 @@ static void eval_libc_speed(void *ptr) {
     }
 }
 
+/*****************************************************************
+ * The -s slab comparison. A trace with no reallocs and at most
+ * SLAB_MAX_CACHES distinct request sizes can be served by slab.c,
+ * with one cache per size. We check it with the same range tree as
+ * mm malloc, then measure its utilization and throughput. The slab
+ * allocator carves the memlib heap itself, so it runs on its own.
+ ****************************************************************/
+
+/*
+ * slab_classify - give every request of the trace the index of its
+ *     size in run->sizes. Returns 0 if the slab allocator cannot
+ *     serve the trace.
+ */
+static int slab_classify(trace_t *trace, slabrun_t *run) {
+    int i, k;
+    unsigned char *id_cls;
+    traceop_t *op;
+
+    run->trace = trace;
+    run->num_sizes = 0;
+    run->cls = (unsigned char *) malloc(trace->num_ops);
+    id_cls = (unsigned char *) malloc(trace->num_ids);
+    if (run->cls == NULL || id_cls == NULL)
+        unix_error("malloc error in slab_classify");
+
+    for (i = 0; i < trace->num_ops; i++) {
+        op = &trace->ops[i];
+        if (op->type == REALLOC)
+            break;
+        if (op->type == FREE) {
+            run->cls[i] = id_cls[op->index];
+            continue;
+        }
+        for (k = 0; k < run->num_sizes && run->sizes[k] != op->size; k++)
+            ;
+        if (k == run->num_sizes) {
+            if (k == SLAB_MAX_CACHES)
+                break;
+            run->sizes[run->num_sizes++] = op->size;
+        }
+        run->cls[i] = id_cls[op->index] = k;
+    }
+    free(id_cls);
+    if (i < trace->num_ops) {
+        free(run->cls);
+        run->cls = NULL;
+        return 0;
+    }
+    return 1;
+}
+
+/*
+ * slab_start - empty the heap and make a fresh cache for every size
+ */
+static void slab_start(slabrun_t *run) {
+    int k;
+
+    mem_reset_brk();
+    slab_init();
+    for (k = 0; k < run->num_sizes; k++)
+        if ((run->caches[k] = slab_create(run->sizes[k])) == NULL)
+            app_error("slab_create failed");
+}
+
+/*
+ * eval_slab_valid - Check the slab allocator for correctness, as
+ *    eval_mm_valid does for mm malloc
+ */
+static int eval_slab_valid(slabrun_t *run, int tracenum, range_t **ranges) {
+    trace_t *trace = run->trace;
+    int i, index, size;
+    char *p;
+
+    clear_ranges(ranges);
+    slab_start(run);
+    for (i = 0; i < trace->num_ops; i++) {
+        index = trace->ops[i].index;
+        size = trace->ops[i].size;
+        if (trace->ops[i].type == ALLOC) {
+            if ((p = slab_alloc(run->caches[run->cls[i]])) == NULL) {
+                malloc_error(tracenum, i, "slab_alloc failed.");
+                return 0;
+            }
+            if (add_range(ranges, p, size, tracenum, i) == 0)
+                return 0;
+            memset(p, index & 0xFF, size);
+            trace->blocks[index] = p;
+        } else {
+            p = trace->blocks[index];
+            remove_range(ranges, p);
+            slab_free(run->caches[run->cls[i]], p);
+        }
+    }
+    return 1;
+}
+
+/*
+ * eval_slab_util - Evaluate the space utilization of the slab allocator,
+ *    in the same way as eval_mm_util
+ */
+static double eval_slab_util(slabrun_t *run) {
+    trace_t *trace = run->trace;
+    int i, index;
+    int total_size = 0, max_total_size = 0;
+
+    slab_start(run);
+    for (i = 0; i < trace->num_ops; i++) {
+        index = trace->ops[i].index;
+        if (trace->ops[i].type == ALLOC) {
+            trace->blocks[index] = slab_alloc(run->caches[run->cls[i]]);
+            trace->block_sizes[index] = trace->ops[i].size;
+            total_size += trace->ops[i].size;
+            if (total_size > max_total_size)
+                max_total_size = total_size;
+        } else {
+            slab_free(run->caches[run->cls[i]], trace->blocks[index]);
+            total_size -= trace->block_sizes[index];
+        }
+    }
+    return ((double) max_total_size / (double) mem_peak_footprint());
+}
+
+/*
+ * eval_slab_speed - This is the function that is used by fsecs()
+ *    to measure the running time of the slab allocator.
+ */
+static void eval_slab_speed(void *ptr) {
+    slabrun_t *run = (slabrun_t *) ptr;
+    trace_t *trace = run->trace;
+    int i;
+
+    slab_start(run);
+    for (i = 0; i < trace->num_ops; i++) {
+        if (trace->ops[i].type == ALLOC)
+            trace->blocks[trace->ops[i].index] =
+                    slab_alloc(run->caches[run->cls[i]]);
+        else
+            slab_free(run->caches[run->cls[i]],
+                      trace->blocks[trace->ops[i].index]);
+    }
+}
+
+
+/*****************************************************************
+ * The -F fit policy sweep. mm.c picks its fit policy in mm_init from
+ * the MM_FIT environment variable, so we set the variable and rerun
+ * every trace under each policy, then print a table of utilization
+ * against throughput that marks the Pareto-optimal policies.
+ ****************************************************************/
+
+/*
+ * eval_fit_sweep - run all traces under every policy in fit_policies[]
+ */
+static void eval_fit_sweep(char **tracefiles, int num_tracefiles) {
+    int i, j, k, dominated;
+    int nfits = sizeof(fit_policies) / sizeof(char *) - 1;
+    fit_t *fits;
+    stats_t stats;
+    trace_t *trace;
+    range_t *ranges = NULL;
+    speed_t speed_params;
+    char *saved = getenv("MM_FIT");
+    double kops, p1, p2;
+
+    if (saved != NULL)
+        saved = strdup(saved);
+    if ((fits = (fit_t *) calloc(nfits, sizeof(fit_t))) == NULL)
+        unix_error("fits calloc in eval_fit_sweep failed");
+
+    for (k = 0; k < nfits; k++) {
+        fits[k].policy = fit_policies[k];
+        fits[k].valid = 1;
+        setenv("MM_FIT", fit_policies[k], 1);
+        if (verbose > 1)
+            printf("Sweeping fit policy %s\n", fit_policies[k]);
+        for (i = 0; i < num_tracefiles; i++) {
+            trace = read_trace(tracedir, tracefiles[i]);
+            memset(&stats, 0, sizeof(stats));
+            if (!eval_mm_valid(trace, i, &ranges)) {
+                fits[k].valid = 0;
+                free_trace(trace);
+                continue;
+            }
+            fits[k].util += eval_mm_util(trace, i, &ranges, &stats, NULL, NULL);
+            speed_params.trace = trace;
+            speed_params.ranges = ranges;
+            fits[k].secs += fsecs(eval_mm_speed, &speed_params);
+            fits[k].ops += trace->num_ops;
+            free_trace(trace);
+        }
+        fits[k].util /= num_tracefiles;
+    }
+
+    if (saved != NULL) {
+        setenv("MM_FIT", saved, 1);
+        free(saved);
+    } else
+        unsetenv("MM_FIT");
+
+    printf("\nFit policy sweep (* = Pareto optimal in util and Kops):\n");
+    printf("%7s%7s%8s%7s%8s\n", "policy", "util", "Kops", "perf", "pareto");
+    for (k = 0; k < nfits; k++) {
+        if (!fits[k].valid) {
+            printf("%7s%7s%8s%7s%8s\n", fits[k].policy, "-", "-", "-", "-");
+            continue;
+        }
+        kops = fits[k].ops / 1e3 / fits[k].secs;
+        p1 = UTIL_WEIGHT * fits[k].util;
+        p2 = (1.0 - UTIL_WEIGHT) *
+             (kops * 1e3 > AVG_LIBC_THRUPUT ? 1.0 : kops * 1e3 / AVG_LIBC_THRUPUT);
+
+        /* a policy is dominated if another is at least as good in both */
+        dominated = 0;
+        for (j = 0; j < nfits; j++) {
+            if (j == k || !fits[j].valid)
+                continue;
+            if (fits[j].util >= fits[k].util &&
+                fits[j].ops / fits[j].secs >= fits[k].ops / fits[k].secs &&
+                (fits[j].util > fits[k].util ||
+                 fits[j].ops / fits[j].secs > fits[k].ops / fits[k].secs))
+                dominated = 1;
+        }
+        printf("%7s%6.0f%%%8.0f%7.0f%8s\n", fits[k].policy,
+               fits[k].util * 100.0, kops, (p1 + p2) * 100.0,
+               dominated ? "" : "*");
+    }
+    free(fits);
+}
+
+/*****************************************************************
+ * The -b backend comparison. Every allocator in backends[] replays
+ * each trace through the backend_t function pointers, so they all pay
+ * the same indirect call per request. Backends on the memlib heap are
+ * checked with the range tree and get a utilization; libc is only
+ * checked for failed requests, as in eval_libc_valid. A backend that
+ * runs out of memory on a trace is reported as "-" for it.
+ ****************************************************************/
+
+/* The allocators compared by -b; mm comes first as the reference */
+static backend_t backends[] = {
+        {"mm", 1, mm_start, mm_malloc, mm_free, mm_realloc},
+        {"libc", 0, libc_start, malloc, free, realloc},
+        {"bump", 1, bump_start, bump_malloc, bump_free, bump_realloc},
+        {NULL}
+};
+
+/*
+ * mm_start, libc_start, bump_start - begin a run of each backend
+ */
+static int mm_start(void) {
+    mem_reset_brk();
+    return mm_init();
+}
+
+static int libc_start(void) {
+    return 0;
+}
+
+static int bump_start(void) {
+    mem_reset_brk();
+    return bump_init();
+}
+
+/*
+ * eval_backends - run all traces with every backend and print each
+ *     trace's utilization and throughput, with the throughput relative
+ *     to mm malloc
+ */
+static void eval_backends(char **tracefiles, int num_tracefiles) {
+    int i, k, all, ntotal = 0;
+    int nb = sizeof(backends) / sizeof(backend_t) - 1;
+    stats_t *stats, *st;
+    trace_t *trace;
+    range_t *ranges = NULL;
+    speed_t speed_params;
+    double *ops, *secs, *util;
+    char name[MAXLINE];
+
+    stats = (stats_t *) calloc(nb * num_tracefiles, sizeof(stats_t));
+    ops = (double *) calloc(3 * nb, sizeof(double));
+    if (stats == NULL || ops == NULL)
+        unix_error("calloc in eval_backends failed");
+    secs = ops + nb;
+    util = secs + nb;
+
+    for (i = 0; i < num_tracefiles; i++) {
+        trace = read_trace(tracedir, tracefiles[i]);
+        for (k = 0; k < nb; k++) {
+            st = &stats[i * nb + k];
+            st->ops = trace->num_ops;
+            if (verbose > 1)
+                printf("Running %s on trace %d\n", backends[k].name, i);
+            if (!(st->valid = eval_backend_valid(&backends[k], trace, i, &ranges)))
+                continue;
+            if (backends[k].on_memlib)
+                st->util = eval_backend_util(&backends[k], trace);
+            speed_params.trace = trace;
+            speed_params.backend = &backends[k];
+            st->secs = fsecs(eval_backend_speed, &speed_params);
+        }
+        free_trace(trace);
+    }
+    clear_ranges(&ranges);
+
+    printf("\nAllocator backends (x mm = throughput relative to mm):\n");
+    printf("%5s", "trace");
+    for (k = 0; k < nb; k++) {
+        sprintf(name, "%s util", backends[k].name);
+        printf("%11s%8s", name, "Kops");
+        if (k > 0)
+            printf("%7s", "x mm");
+    }
+    printf("\n");
+    for (i = 0; i < num_tracefiles; i++) {
+        st = &stats[i * nb];
+        printf("%5d", i);
+        for (all = 1, k = 0; k < nb; k++) {
+            if (!st[k].valid) {
+                printf("%11s%8s%s", "-", "-", k > 0 ? "      -" : "");
+                all = 0;
+                continue;
+            }
+            if (backends[k].on_memlib)
+                printf("%10.0f%%", st[k].util * 100.0);
+            else
+                printf("%11s", "-");
+            printf("%8.0f", st[k].ops / 1e3 / st[k].secs);
+            if (k > 0 && st[0].valid)
+                printf("%7.2f", st[0].secs / st[k].secs);
+            else if (k > 0)
+                printf("%7s", "-");
+        }
+        printf("\n");
+
+        /* the totals only cover traces that every backend ran */
+        for (k = 0; all && k < nb; k++) {
+            ops[k] += st[k].ops;
+            secs[k] += st[k].secs;
+            util[k] += st[k].util;
+        }
+        ntotal += all;
+    }
+    if (ntotal > 0) {
+        printf("%5s", "Total");
+        for (k = 0; k < nb; k++) {
+            if (backends[k].on_memlib)
+                printf("%10.0f%%", util[k] / ntotal * 100.0);
+            else
+                printf("%11s", "-");
+            printf("%8.0f", ops[k] / 1e3 / secs[k]);
+            if (k > 0)
+                printf("%7.2f", (ops[k] / secs[k]) / (ops[0] / secs[0]));
+        }
+        printf("\n");
+    }
+    free(ops);
+    free(stats);
+}
+
+/*
+ * eval_backend_valid - Check backend b on a trace as eval_mm_valid
+ *     does, skipping the range checks for libc, whose blocks are not
+ *     on the memlib heap. Returns 0 if b fails.
+ */
+static int eval_backend_valid(backend_t *b, trace_t *trace, int tracenum,
+                              range_t **ranges) {
+    int i, j, index, size, oldsize;
+    char *p, *oldp;
+
+    clear_ranges(ranges);
+    if (b->start() < 0) {
+        malloc_error(tracenum, 0, "backend start failed.");
+        return 0;
+    }
+    for (i = 0; i < trace->num_ops; i++) {
+        index = trace->ops[i].index;
+        size = trace->ops[i].size;
+        switch (trace->ops[i].type) {
+
+            case ALLOC:
+                if ((p = b->malloc(size)) == NULL) {
+                    if (verbose > 1)
+                        printf("%s malloc failed on request %d\n", b->name, i);
+                    return 0;
+                }
+                if (b->on_memlib && add_range(ranges, p, size, tracenum, i) == 0)
+                    return 0;
+                memset(p, index & 0xFF, size);
+                trace->blocks[index] = p;
+                trace->block_sizes[index] = size;
+                break;
+
+            case REALLOC:
+                oldp = trace->blocks[index];
+                if ((p = b->realloc(oldp, size)) == NULL) {
+                    if (verbose > 1)
+                        printf("%s realloc failed on request %d\n", b->name, i);
+                    return 0;
+                }
+                if (b->on_memlib) {
+                    remove_range(ranges, oldp);
+                    if (add_range(ranges, p, size, tracenum, i) == 0)
+                        return 0;
+                }
+                oldsize = trace->block_sizes[index];
+                if (size < oldsize)
+                    oldsize = size;
+                for (j = 0; j < oldsize; j++) {
+                    if ((unsigned char) p[j] != (index & 0xFF)) {
+                        malloc_error(tracenum, i, "realloc did not preserve the "
+                                                  "data from old block");
+                        return 0;
+                    }
+                }
+                memset(p, index & 0xFF, size);
+                trace->blocks[index] = p;
+                trace->block_sizes[index] = size;
+                break;
+
+            case FREE:
+                p = trace->blocks[index];
+                if (b->on_memlib)
+                    remove_range(ranges, p);
+                b->free(p);
+                break;
+        }
+    }
+    return 1;
+}
+
+/*
+ * eval_backend_util - Evaluate the space utilization of a memlib
+ *     backend, in the same way as eval_mm_util
+ */
+static double eval_backend_util(backend_t *b, trace_t *trace) {
+    int i, index, size;
+    int total_size = 0, max_total_size = 0;
+
+    if (b->start() < 0)
+        app_error("backend start failed in eval_backend_util");
+    for (i = 0; i < trace->num_ops; i++) {
+        index = trace->ops[i].index;
+        size = trace->ops[i].size;
+        switch (trace->ops[i].type) {
+
+            case ALLOC:
+                trace->blocks[index] = b->malloc(size);
+                total_size += size;
+                trace->block_sizes[index] = size;
+                break;
+
+            case REALLOC:
+                trace->blocks[index] = b->realloc(trace->blocks[index], size);
+                total_size += size - trace->block_sizes[index];
+                trace->block_sizes[index] = size;
+                break;
+
+            case FREE:
+                b->free(trace->blocks[index]);
+                total_size -= trace->block_sizes[index];
+                break;
+        }
+        if (total_size > max_total_size)
+            max_total_size = total_size;
+    }
+    return ((double) max_total_size / (double) mem_peak_footprint());
+}
+
+/*
+ * eval_backend_speed - This is the function that is used by fsecs()
+ *    to measure the running time of a backend.
+ */
+static void eval_backend_speed(void *ptr) {
+    trace_t *trace = ((speed_t *) ptr)->trace;
+    backend_t *b = ((speed_t *) ptr)->backend;
+    int i, index;
+
+    if (b->start() < 0)
+        app_error("backend start failed in eval_backend_speed");
+    for (i = 0; i < trace->num_ops; i++) {
+        index = trace->ops[i].index;
+        switch (trace->ops[i].type) {
+
+            case ALLOC:
+                trace->blocks[index] = b->malloc(trace->ops[i].size);
+                break;
+
+            case REALLOC:
+                trace->blocks[index] = b->realloc(trace->blocks[index],
+                                                  trace->ops[i].size);
+                break;
+
+            case FREE:
+                b->free(trace->blocks[index]);
+                break;
+        }
+    }
+}
+
+/*****************************************************************
+ * The following routines measure how the mm and libc malloc packages
+ * scale when a trace is replayed by several threads at once. The
+ * block ids of the trace are partitioned round-robin across threads,
+ * so every thread issues the requests for its own ids in trace order
+ * and the total amount of work does not depend on the thread count.
+ ****************************************************************/
+
+/*
+ * replay_thread - Wait at the start barrier, then replay the requests
+ *    assigned to this thread. Calls into mm.c are serialized by mm_lock.
+ */
+static void *replay_thread(void *vargp) {
+    replay_t *rp = (replay_t *) vargp;
+    trace_t *trace = rp->trace;
+    traceop_t *op;
+    char *p;
+    int i;
+
+    pthread_barrier_wait(rp->barrier);
+    gettimeofday(&rp->start, NULL);
+    for (i = 0; i < rp->num_ops; i++) {
+        op = &trace->ops[rp->opnums[i]];
+        if (rp->use_mm)
+            pthread_mutex_lock(&mm_lock);
+        switch (op->type) {
+            case ALLOC:
+                p = rp->use_mm ? mm_malloc(op->size) : malloc(op->size);
+                if (p == NULL)
+                    app_error("malloc failed in replay_thread");
+                trace->blocks[op->index] = p;
+                break;
+            case REALLOC:
+                p = trace->blocks[op->index];
+                p = rp->use_mm ? mm_realloc(p, op->size) : realloc(p, op->size);
+                if (p == NULL)
+                    app_error("realloc failed in replay_thread");
+                trace->blocks[op->index] = p;
+                break;
+            case FREE:
+                if (rp->use_mm)
+                    mm_free(trace->blocks[op->index]);
+                else
+                    free(trace->blocks[op->index]);
+                break;
+        }
+        if (rp->use_mm)
+            pthread_mutex_unlock(&mm_lock);
+    }
+    gettimeofday(&rp->end, NULL);
+    return NULL;
+}
+
+/*
+ * eval_mt_speed - Replay the trace on nthreads threads and return the
+ *    best wall-clock time, measured from the first thread leaving the
+ *    start barrier until the last thread has finished, over MT_RUNS runs.
+ *    The threads take their own timestamps because the releasing thread
+ *    may not run again until the others are done.
+ */
+static double eval_mt_speed(trace_t *trace, int nthreads, int use_mm) {
+    pthread_t *tids;
+    replay_t *args;
+    pthread_barrier_t barrier;
+    double start, end, secs, best = DBL_MAX;
+    int i, t, run;
+
+    if ((tids = (pthread_t *) malloc(nthreads * sizeof(pthread_t))) == NULL ||
+        (args = (replay_t *) calloc(nthreads, sizeof(replay_t))) == NULL)
+        unix_error("malloc failed in eval_mt_speed");
+
+    /* Assign each request to the thread that owns its block id */
+    for (t = 0; t < nthreads; t++) {
+        if ((args[t].opnums = (int *) malloc(trace->num_ops * sizeof(int))) == NULL)
+            unix_error("malloc failed in eval_mt_speed");
+        args[t].trace = trace;
+        args[t].use_mm = use_mm;
+        args[t].barrier = &barrier;
+    }
+    for (i = 0; i < trace->num_ops; i++) {
+        t = trace->ops[i].index % nthreads;
+        args[t].opnums[args[t].num_ops++] = i;
+    }
+
+    for (run = 0; run < MT_RUNS; run++) {
+        if (use_mm) {
+            mem_reset_brk();
+            if (mm_init() < 0)
+                app_error("mm_init failed in eval_mt_speed");
+        }
+        pthread_barrier_init(&barrier, NULL, nthreads + 1);
+        for (t = 0; t < nthreads; t++)
+            if (pthread_create(&tids[t], NULL, replay_thread, &args[t]) != 0)
+                unix_error("pthread_create failed in eval_mt_speed");
+
+        pthread_barrier_wait(&barrier);
+        for (t = 0; t < nthreads; t++)
+            pthread_join(tids[t], NULL);
+        pthread_barrier_destroy(&barrier);
+
+        start = DBL_MAX;
+        end = 0;
+        for (t = 0; t < nthreads; t++) {
+            secs = args[t].start.tv_sec + 1E-6 * args[t].start.tv_usec;
+            start = (secs < start) ? secs : start;
+            secs = args[t].end.tv_sec + 1E-6 * args[t].end.tv_usec;
+            end = (secs > end) ? secs : end;
+        }
+        secs = end - start;
+        if (secs < best)
+            best = secs;
+    }
+
+    for (t = 0; t < nthreads; t++)
+        free(args[t].opnums);
+    free(args);
+    free(tids);
+    return best;
+}
+
+/*
+ * eval_scalability - Sweep the thread count over 1, 2, 4, ... up to
+ *    max_threads and report the throughput and scaling efficiency
+ *    (speedup over one thread divided by the thread count) of both
+ *    the mm and libc malloc packages.
+ */
+static void eval_scalability(trace_t *trace, int tracenum, int max_threads,
+                             FILE *csvfile) {
+    scale_t sc, base;
+    double ops = trace->num_ops;
+    double mm_eff, libc_eff;
+    int n;
+
+    for (n = 1; ; n = (n * 2 < max_threads) ? n * 2 : max_threads) {
+        sc.threads = n;
+        sc.mm_secs = eval_mt_speed(trace, n, 1);
+        sc.libc_secs = eval_mt_speed(trace, n, 0);
+        if (n == 1)
+            base = sc;
+        mm_eff = base.mm_secs / (sc.mm_secs * n);
+        libc_eff = base.libc_secs / (sc.libc_secs * n);
+
+        printf("%2d%11d%10.0f%5.0f%%%10.0f%5.0f%%\n",
+               tracenum, n,
+               (ops / 1e3) / sc.mm_secs, mm_eff * 100.0,
+               (ops / 1e3) / sc.libc_secs, libc_eff * 100.0);
+        if (csvfile) {
+            fprintf(csvfile, "%d,%d,mm,%.0f,%.6f,%.1f,%.3f,%.3f\n",
+                    tracenum, n, ops, sc.mm_secs, (ops / 1e3) / sc.mm_secs,
+                    base.mm_secs / sc.mm_secs, mm_eff);
+            fprintf(csvfile, "%d,%d,libc,%.0f,%.6f,%.1f,%.3f,%.3f\n",
+                    tracenum, n, ops, sc.libc_secs, (ops / 1e3) / sc.libc_secs,
+                    base.libc_secs / sc.libc_secs, libc_eff);
+        }
+        if (n == max_threads)
+            break;
+    }
+}
+
 /*************************************
  * Some miscellaneous helper routines
  ************************************/
@@ -956,6 +2245,135 @@ static void printresults(int n, stats_t *stats) {
 
 }
 
+/*
+ * printfootprint - prints the peak and final resident heap size of the
+ *    mm malloc package for each trace, and its dTLB misses if counted
+ */
+static void printfootprint(int n, stats_t *stats) {
+    int i;
+
+    printf("%5s%7s%10s%10s%12s\n",
+           "trace", " valid", "peak KB", "final KB", "dTLB miss");
+    for (i = 0; i < n; i++) {
+        if (!stats[i].valid)
+            printf("%2d%10s%10s%10s%12s\n", i, "no", "-", "-", "-");
+        else if (stats[i].tlb_misses < 0)
+            printf("%2d%10s%10.0f%10.0f%12s\n", i, "yes",
+                   stats[i].peak_rss / 1024, stats[i].final_rss / 1024, "-");
+        else
+            printf("%2d%10s%10.0f%10.0f%12.0f\n", i, "yes",
+                   stats[i].peak_rss / 1024, stats[i].final_rss / 1024,
+                   stats[i].tlb_misses);
+    }
+}
+
+/*
+ * printlatency - prints latency percentiles of each request type of
+ *    the mm malloc package for each trace, followed by the slowest
+ *    requests of each trace
+ */
+static void printlatency(int n, lathist_t *lat_stats) {
+    static char *opnames[NUM_OPTYPES] = {"malloc", "free", "realloc"};
+    lat_outlier_t worst[NUM_OPTYPES * LAT_WORST];
+    int wtype[NUM_OPTYPES * LAT_WORST];
+    lathist_t *h;
+    int i, t, j, k, best;
+
+    printf("Request latency for mm malloc (%s):\n", lat_unit());
+    printf("%5s%8s%9s%8s%8s%8s%8s%10s\n",
+           "trace", "op", "count", "p50", "p90", "p99", "p99.9", "max");
+    for (i = 0; i < n; i++) {
+        for (t = 0; t < NUM_OPTYPES; t++) {
+            h = &lat_stats[i * NUM_OPTYPES + t];
+            if (h->count == 0)
+                continue;
+            printf("%2d%11s%9lu%8lu%8lu%8lu%8lu%10lu\n",
+                   i, opnames[t],
+                   (unsigned long) h->count,
+                   (unsigned long) lat_percentile(h, 0.50),
+                   (unsigned long) lat_percentile(h, 0.90),
+                   (unsigned long) lat_percentile(h, 0.99),
+                   (unsigned long) lat_percentile(h, 0.999),
+                   (unsigned long) h->max);
+        }
+    }
+
+    /* Merge the outliers of the request types and print the slowest */
+    printf("\nSlowest requests for mm malloc (%s):\n", lat_unit());
+    printf("%5s%8s%8s%10s\n", "trace", "op", "line", lat_unit());
+    for (i = 0; i < n; i++) {
+        k = 0;
+        for (t = 0; t < NUM_OPTYPES; t++) {
+            h = &lat_stats[i * NUM_OPTYPES + t];
+            for (j = 0; j < LAT_WORST && j < h->count; j++) {
+                worst[k] = h->worst[j];
+                wtype[k++] = t;
+            }
+        }
+        for (j = 0; j < LAT_WORST && k > 0; j++) {
+            for (best = 0, t = 1; t < k; t++)
+                if (worst[t].ns > worst[best].ns)
+                    best = t;
+            printf("%2d%11s%8d%10lu\n", i, opnames[wtype[best]],
+                   LINENUM(worst[best].opnum),
+                   (unsigned long) worst[best].ns);
+            worst[best] = worst[--k];
+            wtype[best] = wtype[k];
+        }
+    }
+    printf("\n");
+}
+
+/*
+ * printinternals - prints the MM_STATS counters of the mm malloc
+ *    package for each trace: find_fit calls and the mean number of
+ *    blocks each one scanned, splits, coalesces by case, heap growth,
+ *    mallocs served by the quick lists, and the mean external fragmentation
+ */
+static void printinternals(int n, stats_t *stats) {
+    int i;
+    mm_stats_t *m;
+
+    printf("%5s%9s%7s%8s%21s%7s%9s%9s%7s\n", "trace", "fits", "scan",
+           "splits", "coalesce 1/2/3/4", "extend", "ext KB", "quick", "frag");
+    for (i = 0; i < n; i++) {
+        m = &stats[i].internals;
+        if (!stats[i].valid) {
+            printf("%2d%12s\n", i, "-");
+            continue;
+        }
+        printf("%2d%12lu%7.1f%8lu%6lu/%4lu/%4lu/%4lu%7lu%9lu%9lu%6.0f%%\n", i,
+               m->fit_calls,
+               m->fit_calls ? (double) m->fit_scanned / m->fit_calls : 0.0,
+               m->splits,
+               m->coalesce[0], m->coalesce[1], m->coalesce[2], m->coalesce[3],
+               m->extends, m->extend_bytes / 1024, m->quick_hits,
+               stats[i].frag * 100.0);
+    }
+}
+
+/*
+ * printslab - prints the utilization and throughput of mm malloc and
+ *    the slab allocator side by side for each trace
+ */
+static void printslab(int n, stats_t *mm_stats, stats_t *slab_stats) {
+    int i;
+
+    printf("%5s%9s%11s%10s%11s\n",
+           "trace", "mm util", "slab util", "mm Kops", "slab Kops");
+    for (i = 0; i < n; i++) {
+        if (!mm_stats[i].valid || !slab_stats[i].valid) {
+            printf("%2d%12s%11s%10s%11s\n", i, "-", "-", "-", "-");
+            continue;
+        }
+        printf("%2d%11.0f%%%10.0f%%%10.0f%11.0f\n", i,
+               mm_stats[i].util * 100.0,
+               slab_stats[i].util * 100.0,
+               mm_stats[i].ops / 1e3 / mm_stats[i].secs,
+               slab_stats[i].ops / 1e3 / slab_stats[i].secs);
+    }
+}
+
 /* 
  * app_error - Report an arbitrary application error
  */
@@ -984,14 +2402,25 @@ void malloc_error(int tracenum, int opnum, char *msg) {
  * usage - Explain the command line arguments
  */
 static void usage(void) {
-    fprintf(stderr, "Usage: mdriver [-hvVal] [-f <file>] [-t <dir>]\n");
+    fprintf(stderr, "Usage: mdriver [-hvVablsCTLF] [-f <file>] [-t <dir>] [-j <n>] [-c <csv>] [-m <csv>] [-r <csv>]\n");
     fprintf(stderr, "Options\n");
     fprintf(stderr, "\t-a         Don't check the team structure.\n");
+    fprintf(stderr, "\t-b         Compare mm with the libc and bump allocators.\n");
+    fprintf(stderr, "\t-C         Run mm_check after every request of the correctness pass.\n");
+    fprintf(stderr, "\t-c <csv>   Write -j scalability results to <csv>.\n");
     fprintf(stderr, "\t-f <file>  Use <file> as the trace file.\n");
+    fprintf(stderr, "\t-F         Compare the mm fit policies on all traces.\n");
     fprintf(stderr, "\t-g         Generate summary info for autograder.\n");
     fprintf(stderr, "\t-h         Print this message.\n");
+    fprintf(stderr, "\t-j <n>     Replay traces on 1, 2, 4, ... <n> threads.\n");
     fprintf(stderr, "\t-l         Run libc malloc as well.\n");
+    fprintf(stderr, "\t-m <csv>   Write the mm heap map every %d requests to <csv>.\n",
+            MAP_INTERVAL);
+    fprintf(stderr, "\t-L         Report per-request latency percentiles of mm malloc.\n");
+    fprintf(stderr, "\t-r <csv>   Write the heap RSS over time to <csv>.\n");
+    fprintf(stderr, "\t-s         Compare the slab allocator with mm (slab traces by default).\n");
     fprintf(stderr, "\t-t <dir>   Directory to find default traces.\n");
+    fprintf(stderr, "\t-T         Count dTLB misses of mm malloc (perf_event_open).\n");
     fprintf(stderr, "\t-v         Print per-trace performance breakdowns.\n");
     fprintf(stderr, "\t-V         Print additional debug info.\n");
 }
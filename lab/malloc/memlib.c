@@ -1,8 +1,16 @@
 /*
- * memlib.c - a module that simulates the memory system.  Needed because it 
- *            allows us to interleave calls from the student's malloc package 
+ * memlib.c - a module that simulates the memory system.  Needed because it
+ *            allows us to interleave calls from the student's malloc package
  *            with the system's malloc package in libc.
+ *
+ * With MEM_USE_MMAP set in config.h, the heap is a PROT_NONE reservation
+ * of MAX_HEAP bytes. Pages are committed as the brk pointer grows and
+ * handed back to the kernel with madvise(MADV_DONTNEED) when it shrinks,
+ * so a malloc package that trims its heap really returns memory. With
+ * MEM_HUGEPAGES also set, the reservation is aligned to HUGE_PAGESIZE,
+ * marked MADV_HUGEPAGE, and committed and released in whole huge pages.
  */
+#define _GNU_SOURCE /* for mremap */
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
@@ -14,56 +22,223 @@
 #include "memlib.h"
 #include "config.h"
 
+#if MEM_HUGEPAGES && !MEM_USE_MMAP
+#error "MEM_HUGEPAGES requires MEM_USE_MMAP"
+#endif
+
+#if MEM_HUGEPAGES
+#define COMMIT_UNIT HUGE_PAGESIZE    /* granularity of commits and releases */
+#else
+#define COMMIT_UNIT mem_pagesize()
+#endif
+
+/* Records one direct mapping handed out by mem_map */
+typedef struct map_t {
+    char *lo;              /* first byte of the mapping */
+    size_t size;           /* length of the mapping in bytes */
+    struct map_t *next;    /* next list element */
+} map_t;
+
 /* private variables */
 static char *mem_start_brk;  /* points to first byte of heap */
 static char *mem_brk;        /* points to last byte of heap */
 static char *mem_max_addr;   /* largest legal heap address */
+static char *mem_commit;     /* end of the pages committed for the heap */
+static map_t *mem_maps;      /* list of live direct mappings */
+static size_t mem_mapped;    /* total bytes in direct mappings */
+static size_t mem_peak;      /* high water mark of mem_footprint() */
 
-/* 
+/* function prototypes */
+static char *align_up(char *addr, size_t unit);
+static int commit_pages(char *new_brk);
+static void update_peak(void);
+static size_t resident_bytes(char *lo, size_t size);
+
+/*
  * mem_init - initialize the memory system model
  */
 void mem_init(void) {
+#if MEM_USE_MMAP
+    char *base;
+    size_t slack = MEM_HUGEPAGES ? HUGE_PAGESIZE : 0;
+
+    /* reserve, but do not commit, the address space of the heap */
+    base = mmap(NULL, MAX_HEAP + slack, PROT_NONE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (base == MAP_FAILED) {
+        fprintf(stderr, "mem_init_vm: mmap error\n");
+        exit(1);
+    }
+
+    /* trim the reservation so that it starts on a huge page boundary */
+    mem_start_brk = slack ? align_up(base, slack) : base;
+    if (mem_start_brk > base)
+        munmap(base, mem_start_brk - base);
+    if (base + slack > mem_start_brk)
+        munmap(mem_start_brk + MAX_HEAP, base + slack - mem_start_brk);
+#if MEM_HUGEPAGES
+    if (madvise(mem_start_brk, MAX_HEAP, MADV_HUGEPAGE) < 0)
+        fprintf(stderr, "mem_init_vm: madvise(MADV_HUGEPAGE) failed, "
+                        "using base pages\n");
+#endif
+#else
     /* allocate the storage we will use to model the available VM */
     if ((mem_start_brk = (char *) malloc(MAX_HEAP)) == NULL) {
         fprintf(stderr, "mem_init_vm: malloc error\n");
         exit(1);
     }
+#endif
 
     mem_max_addr = mem_start_brk + MAX_HEAP;  /* max legal heap address */
     mem_brk = mem_start_brk;                  /* heap is empty initially */
+    mem_commit = mem_start_brk;
+    mem_maps = NULL;
+    mem_mapped = 0;
+    mem_peak = 0;
 }
 
-/* 
+/*
  * mem_deinit - free the storage used by the memory system model
  */
 void mem_deinit(void) {
+    mem_reset_brk();
+#if MEM_USE_MMAP
+    munmap(mem_start_brk, MAX_HEAP);
+#else
     free(mem_start_brk);
+#endif
 }
 
 /*
- * mem_reset_brk - reset the simulated brk pointer to make an empty heap
+ * mem_reset_brk - reset the simulated brk pointer to make an empty heap,
+ *    dropping any direct mappings that the malloc package leaked
  */
 void mem_reset_brk() {
-    mem_brk = mem_start_brk;
+    map_t *p, *pnext;
+
+    for (p = mem_maps; p != NULL; p = pnext) {
+        pnext = p->next;
+        munmap(p->lo, p->size);
+        free(p);
+    }
+    mem_maps = NULL;
+    mem_mapped = 0;
+
+    mem_sbrk((int) (mem_start_brk - mem_brk));
+    mem_peak = 0;
 }
 
-/* 
- * mem_sbrk - simple model of the sbrk function. Extends the heap 
- *    by incr bytes and returns the start address of the new area. In
- *    this model, the heap cannot be shrunk.
+/*
+ * mem_sbrk - simple model of the sbrk function. Extends the heap
+ *    by incr bytes and returns the start address of the new area. A
+ *    negative incr shrinks the heap; whole pages above the new brk
+ *    are returned to the kernel.
  */
 void *mem_sbrk(int incr) {
     char *old_brk = mem_brk;
 
-    if ((incr < 0) || ((mem_brk + incr) > mem_max_addr)) {
+    if (((mem_brk + incr) < mem_start_brk) || ((mem_brk + incr) > mem_max_addr)) {
         errno = ENOMEM;
         fprintf(stderr, "ERROR: mem_sbrk failed. Ran out of memory...\n");
         return (void *) -1;
     }
+    if (commit_pages(mem_brk + incr) < 0) {
+        errno = ENOMEM;
+        fprintf(stderr, "ERROR: mem_sbrk failed. Could not commit pages...\n");
+        return (void *) -1;
+    }
     mem_brk += incr;
+    update_peak();
     return (void *) old_brk;
 }
 
+/*
+ * mem_map - map size bytes of fresh memory outside of the heap, for
+ *    blocks too large to be carved out of it. Returns NULL on failure.
+ */
+void *mem_map(size_t size) {
+    map_t *p;
+    char *lo;
+
+    size = (size_t) align_up((char *) size, mem_pagesize());
+    lo = mmap(NULL, size, PROT_READ | PROT_WRITE,
+              MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (lo == MAP_FAILED)
+        return NULL;
+
+    if ((p = (map_t *) malloc(sizeof(map_t))) == NULL) {
+        munmap(lo, size);
+        return NULL;
+    }
+    p->lo = lo;
+    p->size = size;
+    p->next = mem_maps;
+    mem_maps = p;
+    mem_mapped += size;
+    update_peak();
+    return lo;
+}
+
+/*
+ * mem_remap - resize a mapping returned by mem_map, moving it if needed.
+ *    Returns the new address of the mapping, or NULL on failure.
+ */
+void *mem_remap(void *ptr, size_t size) {
+    map_t *p;
+    char *lo;
+
+    size = (size_t) align_up((char *) size, mem_pagesize());
+    for (p = mem_maps; p != NULL; p = p->next) {
+        if (p->lo == (char *) ptr) {
+            lo = mremap(p->lo, p->size, size, MREMAP_MAYMOVE);
+            if (lo == MAP_FAILED)
+                return NULL;
+            mem_mapped += size - p->size;
+            p->lo = lo;
+            p->size = size;
+            update_peak();
+            return lo;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * mem_unmap - release a mapping returned by mem_map
+ */
+void mem_unmap(void *ptr, size_t size) {
+    map_t *p;
+    map_t **prevpp = &mem_maps;
+
+    for (p = mem_maps; p != NULL; p = p->next) {
+        if (p->lo == (char *) ptr) {
+            *prevpp = p->next;
+            munmap(p->lo, p->size);
+            mem_mapped -= p->size;
+            free(p);
+            return;
+        }
+        prevpp = &(p->next);
+    }
+    fprintf(stderr, "ERROR: mem_unmap of %p (%lu bytes) not mapped\n",
+            ptr, (unsigned long) size);
+}
+
+/*
+ * mem_owns - return true if the bytes lo..hi lie inside the heap or
+ *    inside a single direct mapping
+ */
+int mem_owns(void *lo, void *hi) {
+    map_t *p;
+
+    if ((char *) lo >= mem_start_brk && (char *) hi < mem_brk)
+        return 1;
+    for (p = mem_maps; p != NULL; p = p->next)
+        if ((char *) lo >= p->lo && (char *) hi < p->lo + p->size)
+            return 1;
+    return 0;
+}
+
 /*
  * mem_heap_lo - return address of the first heap byte
  */
@@ -71,7 +246,7 @@ void *mem_heap_lo() {
     return (void *) mem_start_brk;
 }
 
-/* 
+/*
  * mem_heap_hi - return address of last heap byte
  */
 void *mem_heap_hi() {
@@ -91,3 +266,114 @@ size_t mem_heapsize() {
 size_t mem_pagesize() {
     return (size_t) getpagesize();
 }
+
+/*
+ * mem_hugepagesize() - returns the huge page size backing the heap,
+ *    or 0 if the heap is backed by base pages
+ */
+size_t mem_hugepagesize() {
+#if MEM_HUGEPAGES
+    return HUGE_PAGESIZE;
+#else
+    return 0;
+#endif
+}
+
+/*
+ * mem_footprint - returns the heap size plus the size of all direct mappings
+ */
+size_t mem_footprint() {
+    return mem_heapsize() + mem_mapped;
+}
+
+/*
+ * mem_peak_footprint - returns the high water mark of mem_footprint()
+ *    since the last mem_reset_brk
+ */
+size_t mem_peak_footprint() {
+    return mem_peak;
+}
+
+/*
+ * mem_rss - returns the number of heap and mapping bytes that are
+ *    currently resident in physical memory
+ */
+size_t mem_rss() {
+    map_t *p;
+    size_t rss;
+
+#if MEM_USE_MMAP
+    rss = resident_bytes(mem_start_brk, mem_commit - mem_start_brk);
+#else
+    rss = mem_heapsize(); /* the malloc'd model is never given back */
+#endif
+    for (p = mem_maps; p != NULL; p = p->next)
+        rss += resident_bytes(p->lo, p->size);
+    return rss;
+}
+
+/*
+ * align_up - round an address up to the next multiple of unit, which
+ *    must be a power of two
+ */
+static char *align_up(char *addr, size_t unit) {
+    size_t mask = unit - 1;
+    return (char *) (((size_t) addr + mask) & ~mask);
+}
+
+/*
+ * commit_pages - make the pages below new_brk accessible and give the
+ *    pages above it back to the kernel. Returns -1 on failure.
+ */
+static int commit_pages(char *new_brk) {
+#if MEM_USE_MMAP
+    char *new_commit = align_up(new_brk, COMMIT_UNIT);
+
+    if (new_commit > mem_commit) {
+        if (mprotect(mem_commit, new_commit - mem_commit,
+                     PROT_READ | PROT_WRITE) < 0)
+            return -1;
+    } else if (new_commit < mem_commit) {
+        madvise(new_commit, mem_commit - new_commit, MADV_DONTNEED);
+        mprotect(new_commit, mem_commit - new_commit, PROT_NONE);
+    }
+    mem_commit = new_commit;
+#endif
+    return 0;
+}
+
+/*
+ * update_peak - fold the current footprint into the high water mark
+ */
+static void update_peak(void) {
+    size_t footprint = mem_footprint();
+    if (footprint > mem_peak)
+        mem_peak = footprint;
+}
+
+/*
+ * resident_bytes - count the resident bytes of a page-aligned region
+ */
+static size_t resident_bytes(char *lo, size_t size) {
+    static unsigned char *vec = NULL;
+    static size_t vec_len = 0;
+    size_t pagesize = mem_pagesize();
+    size_t npages = (size + pagesize - 1) / pagesize;
+    size_t i, resident = 0;
+
+    if (npages == 0)
+        return 0;
+    if (npages > vec_len) {
+        free(vec);
+        if ((vec = (unsigned char *) malloc(npages)) == NULL) {
+            vec_len = 0;
+            return 0;
+        }
+        vec_len = npages;
+    }
+    if (mincore(lo, size, vec) < 0)
+        return 0;
+    for (i = 0; i < npages; i++)
+        resident += vec[i] & 1;
+    return resident * pagesize;
+}
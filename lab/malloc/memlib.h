@@ -8,4 +8,15 @@ void *mem_heap_lo(void);
 void *mem_heap_hi(void);
 size_t mem_heapsize(void);
 size_t mem_pagesize(void);
+size_t mem_hugepagesize(void);
 
+/* Direct mappings for large blocks, outside of the sbrk heap */
+void *mem_map(size_t size);
+void *mem_remap(void *ptr, size_t size);
+void mem_unmap(void *ptr, size_t size);
+int mem_owns(void *lo, void *hi);
+
+/* Memory footprint of the heap plus all direct mappings */
+size_t mem_footprint(void);
+size_t mem_peak_footprint(void);
+size_t mem_rss(void);
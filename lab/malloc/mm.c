@@ -18,6 +18,7 @@
 
 #include "mm.h"
 #include "memlib.h"
+#include "config.h"
 
 /*********************************************************
  * NOTE TO STUDENTS: Before you do anything else, please
@@ -36,19 +37,40 @@ team_t team = {
         ""
 };
 
-/* single word (4) or double word (8) alignment */
-#define ALIGNMENT 8
+/*
+ * Payloads are aligned to ALIGNMENT from config.h: 8 bytes in 32-bit
+ * builds, 16 in 64-bit builds, or 32 if set so for AVX payloads.
+ */
 
 /* rounds up to the nearest multiple of ALIGNMENT */
-#define ALIGN(size) (((size) + (ALIGNMENT-1)) & ~0x7)
+#define ALIGN(size) (((size) + (ALIGNMENT-1)) & ~(size_t) (ALIGNMENT-1))
 
 
 #define SIZE_T_SIZE (ALIGN(sizeof(size_t)))
 
-/* Basic constants and macros */
-#define WSIZE 4
-#define DSIZE 8
+/*
+ * Basic constants and macros. Headers and footers are one size_t
+ * word, so blocks can be as large as the address space.
+ */
+#define WSIZE ((int) sizeof(size_t))  /* header/footer word */
+#define DSIZE (2 * WSIZE)             /* header plus footer */
+#define MIN_BLOCK ALIGN(DSIZE + sizeof(char *)) /* room for a quick link */
+#define MAP_PAD ALIGNMENT  /* offset of a mapped block's payload in its mapping */
 #define CHUNKSIZE (1<<12)
+#define MMAP_THRESHOLD (1<<17) /* requests this large get their own mapping */
+#define TRIM_THRESHOLD (1<<16) /* free heap tail beyond this goes back to memlib */
+#define GOOD_FIT_K 8           /* fitting blocks examined by the good fit policy */
+#define QUICK_MAX 128          /* largest block size kept on a quick list */
+#define QUICK_LIMIT 64         /* blocks a quick list holds before it is flushed */
+#define QUICK_LISTS ((QUICK_MAX - MIN_BLOCK) / ALIGNMENT + 1)
+
+/*
+ * Fit policy used by find_fit: "first", "next", "best" or "good". The
+ * MM_FIT environment variable, read by mm_init, overrides this default.
+ */
+#ifndef MM_FIT
+#define MM_FIT "first"
+#endif
 
 #define MAX(x, y) ((x) > (y) ? (x) : (y))
 
@@ -56,12 +78,14 @@ team_t team = {
 #define PACK(size, alloc) ((size) | (alloc))
 
 /* Read and write and allocated fields from address p */
-#define GET(p) (*(unsigned int *)(p))
-#define PUT(p, val) (*(unsigned int*)(p) = (val))
+#define GET(p) (*(size_t *)(p))
+#define PUT(p, val) (*(size_t *)(p) = (val))
 
 /* Read the size and allocated fields from address p */
 #define GET_SIZE(p) (GET(p) & ~0x7)
 #define GET_ALLOC(p) (GET(p) & 0x1)
+#define GET_MAPPED(p) (GET(p) & 0x2)
+#define GET_QUICK(p) (GET(p) & 0x4)
 
 /* Given block ptr bp, compute address of its header and footer */
 #define HDRP(bp) ((char*)(bp)-WSIZE)
@@ -72,9 +96,24 @@ team_t team = {
 #define PREV_BLKP(bp) ((char*)(bp) - GET_SIZE(((char*)(bp) - DSIZE)))
 #define IS_LAST_BLK(bp) (GET_SIZE(HDRP(((char*)bp))) == 1 && GET_ALLOC(HDRP(((char*)bp))))
 
+/* Quick list of blocks of size sz, and the link stored in a quick block */
+#define QUICK_IDX(sz) (((sz) - MIN_BLOCK) / ALIGNMENT)
+#define QUICK_NEXT(bp) (*(char **)(bp))
+
 
 /* global variables */
 void *heap_listp = NULL;
+static char *rover = NULL;  /* where the next fit policy resumes its scan */
+
+/*
+ * Quick lists: LIFO stacks of freed blocks of one small size each. A
+ * quick block keeps its allocated bit, plus the quick bit, so that
+ * coalesce leaves it alone, and is handed out again without splitting.
+ * The blocks are coalesced in a batch when their list overflows or
+ * when an allocation finds no fit.
+ */
+static char *quick[QUICK_LISTS];
+static int quick_len[QUICK_LISTS];
 
 
 /* debug functions */
@@ -82,7 +121,58 @@ void *heap_listp = NULL;
 #ifdef DEBUG
 #define dbg(...) fprintf(stderr, __VA_ARGS__)
 #else
-#define dbg(...) 42
+#define dbg(...) ((void) 0)
+#endif
+
+/* statistics: build with -DMM_STATS=1 to count what each request costs */
+#ifndef MM_STATS
+#define MM_STATS 0
+#endif
+#if MM_STATS
+static mm_stats_t stats;
+#define STAT(expr) (expr)
+#else
+#define STAT(expr)
+#endif
+
+/*
+ * debug mode: build with -DMM_DEBUG=1 to check every pointer given to
+ * mm_free and mm_realloc, guard every payload with the requested size
+ * and a canary, and poison freed payloads and hold them in a
+ * quarantine FIFO before reuse, so that overflows, double frees and
+ * writes after free abort the program. The per-request cost is
+ * bounded by POISON_MAX, and the memory held back by the quarantine
+ * by QUARANTINE_BLOCKS and QUARANTINE_BYTES.
+ */
+#ifndef MM_DEBUG
+#define MM_DEBUG 0
+#endif
+#if MM_DEBUG
+#define GUARD_SIZE DSIZE       /* requested size and canary after the payload */
+#else
+#define GUARD_SIZE 0
+#endif
+#define CANARY ((size_t) 0x5ca1ab1e5ca1ab1eULL)
+#define GUARD_BYTE 0xab        /* fills the slack between payload and guard */
+#define POISON_BYTE 0xdb       /* fills freed payloads */
+#ifndef POISON_MAX
+#define POISON_MAX 512         /* bytes of each freed payload poisoned */
+#endif
+#ifndef QUARANTINE_BLOCKS
+#define QUARANTINE_BLOCKS 256  /* blocks held before the oldest is reused */
+#endif
+#ifndef QUARANTINE_BYTES
+#define QUARANTINE_BYTES (1<<20) /* ... or bytes held */
+#endif
+
+/* Given block ptr bp, compute address of its guard words */
+#define TAILP(bp) ((size_t *) (FTRP(bp) - GUARD_SIZE))
+
+#if MM_DEBUG
+static char *q_head = NULL;    /* oldest quarantined block */
+static char *q_tail = NULL;    /* newest quarantined block */
+static int q_count = 0;        /* blocks in quarantine */
+static size_t q_bytes = 0;     /* bytes in quarantine */
 #endif
 
 
@@ -106,17 +196,21 @@ static void *coalesce(void *bp) {
     size_t size = GET_SIZE(HDRP(bp));
 
     if (prev_alloc && next_alloc) {
+        STAT(stats.coalesce[0]++);
         return bp;
     } else if (prev_alloc && !next_alloc) {
+        STAT(stats.coalesce[1]++);
         size += GET_SIZE(HDRP(NEXT_BLKP(bp)));
         PUT(HDRP(bp), PACK(size, 0));
         PUT(FTRP(bp), PACK(size, 0));
     } else if (!prev_alloc && next_alloc) {
+        STAT(stats.coalesce[2]++);
         size += GET_SIZE(HDRP(PREV_BLKP(bp)));
         PUT((FTRP(bp)), PACK(size, 0));
         PUT(HDRP(PREV_BLKP(bp)), PACK(size, 0));
         bp = PREV_BLKP(bp);
     } else {
+        STAT(stats.coalesce[3]++);
         size += GET_SIZE(HDRP(PREV_BLKP(bp)));
         size += GET_SIZE(FTRP(NEXT_BLKP(bp)));
         PUT(HDRP(PREV_BLKP(bp)), PACK(size, 0));
@@ -124,6 +218,9 @@ static void *coalesce(void *bp) {
         bp = PREV_BLKP(bp);
     }
 
+    /* keep the next fit rover off the interior of the merged block */
+    if (rover > (char *) bp && rover < NEXT_BLKP(bp))
+        rover = bp;
     return bp;
 }
 
@@ -131,10 +228,12 @@ static void *extend_heap(size_t words) {
     char *bp;
     size_t size;
 
-    /* alignment for 2 words*/
-    size = (words % 2) ? ((words + 1) * WSIZE) : (words * WSIZE);
+    /* keep the end of the heap aligned */
+    size = ALIGN(words * WSIZE);
     if ((long) (bp = mem_sbrk(size)) == -1)
         return NULL;
+    STAT(stats.extends++);
+    STAT(stats.extend_bytes += size);
 
     PUT(HDRP(bp), PACK(size, 0)); /* free block header */
     PUT(FTRP(bp), PACK(size, 0)); /* free block footer */
@@ -147,9 +246,70 @@ static void *extend_heap(size_t words) {
 }
 
 
-static void *find_fit(size_t size) {
+/*
+ * trim_heap - give the free block bp back to memlib down to CHUNKSIZE
+ *     bytes if it is the last block of the heap and large enough
+ */
+static void trim_heap(void *bp) {
+    size_t size = GET_SIZE(HDRP(bp));
+    size_t trim;
+
+    if (GET_SIZE(HDRP(NEXT_BLKP(bp))) != 0 || size < CHUNKSIZE + TRIM_THRESHOLD)
+        return;
+    trim = size - CHUNKSIZE;
+    if ((long) mem_sbrk(-(int) trim) == -1)
+        return;
+    PUT(HDRP(bp), PACK(CHUNKSIZE, 0));
+    PUT(FTRP(bp), PACK(CHUNKSIZE, 0));
+    PUT(HDRP(NEXT_BLKP(bp)), PACK(0, 1)); /* new epilogue header */
+    STAT(stats.trims++);
+    STAT(stats.trim_bytes += trim);
+    dbg("trim %zu bytes\n", trim);
+}
+
+/*
+ * map_block - serve a large request from its own memlib mapping. The
+ *     payload starts MAP_PAD bytes in, and the header is tagged with the
+ *     mapped bit so mm_free can unmap it.
+ */
+static void *map_block(size_t adjsize) {
+    char *bp;
+
+    if ((bp = mem_map(adjsize - DSIZE + MAP_PAD)) == NULL)
+        return NULL;
+    bp += MAP_PAD;
+    PUT(HDRP(bp), PACK(adjsize, 0x3));
+    STAT(stats.maps++);
+    return bp;
+}
+
+/*
+ * chunk_size - number of bytes to grow the heap by for a block of
+ *     adjsize bytes. When memlib backs the heap with huge pages, the
+ *     growth is stretched so the new brk ends on a huge page boundary.
+ */
+static size_t chunk_size(size_t adjsize) {
+    size_t hpsize = mem_hugepagesize();
+    size_t size = MAX(adjsize, CHUNKSIZE);
+    size_t end;
+
+    if (hpsize) {
+        end = mem_heapsize() + size;
+        end = (end + hpsize - 1) & ~(hpsize - 1);
+        size = end - mem_heapsize();
+    }
+    return size;
+}
+
+/*
+ * first_fit - return the first free block of at least size bytes,
+ *     scanning from the start of the heap
+ */
+static void *first_fit(size_t size) {
     void *bp = heap_listp;
+    STAT(stats.fit_calls++);
     while (!(GET_SIZE(HDRP(bp)) == 0 && GET_ALLOC(HDRP(bp)) == 1)) {
+        STAT(stats.fit_scanned++);
         if (GET_ALLOC(HDRP(bp)) == 1) {
             bp = NEXT_BLKP(bp);
         } else {
@@ -160,12 +320,156 @@ static void *find_fit(size_t size) {
             }
         }
     }
+    STAT(stats.fit_misses++);
     return NULL;
 }
 
+/*
+ * next_fit - like first_fit, but resume the scan at the block after
+ *     the last one placed, wrapping around at the end of the heap
+ */
+static void *next_fit(size_t size) {
+    char *bp;
+
+    STAT(stats.fit_calls++);
+    for (bp = rover; GET_SIZE(HDRP(bp)) > 0; bp = NEXT_BLKP(bp)) {
+        STAT(stats.fit_scanned++);
+        if (!GET_ALLOC(HDRP(bp)) && GET_SIZE(HDRP(bp)) >= size)
+            return rover = bp;
+    }
+    for (bp = heap_listp; bp < rover; bp = NEXT_BLKP(bp)) {
+        STAT(stats.fit_scanned++);
+        if (!GET_ALLOC(HDRP(bp)) && GET_SIZE(HDRP(bp)) >= size)
+            return rover = bp;
+    }
+    STAT(stats.fit_misses++);
+    return NULL;
+}
+
+/*
+ * bounded_fit - return the smallest of the first k free blocks of at
+ *     least size bytes, stopping early at an exact fit. With k == 0
+ *     every free block is examined (best fit).
+ */
+static void *bounded_fit(size_t size, int k) {
+    char *bp, *best = NULL;
+    size_t bsize, best_size = 0;
+    int seen = 0;
+
+    STAT(stats.fit_calls++);
+    for (bp = heap_listp; GET_SIZE(HDRP(bp)) > 0; bp = NEXT_BLKP(bp)) {
+        STAT(stats.fit_scanned++);
+        if (GET_ALLOC(HDRP(bp)) || (bsize = GET_SIZE(HDRP(bp))) < size)
+            continue;
+        if (best == NULL || bsize < best_size) {
+            best = bp;
+            best_size = bsize;
+            if (bsize == size)
+                break;
+        }
+        if (++seen == k)
+            break;
+    }
+    STAT(stats.fit_misses += (best == NULL));
+    return best;
+}
+
+static void *best_fit(size_t size) {
+    return bounded_fit(size, 0);
+}
+
+static void *good_fit(size_t size) {
+    return bounded_fit(size, GOOD_FIT_K);
+}
+
+/* The fit policies, by name. An implicit list is kept in address
+   order, so address-ordered first fit is first fit. */
+static struct {
+    const char *name;
+    void *(*fit)(size_t size);
+} fit_policies[] = {
+        {"first", first_fit},
+        {"addr",  first_fit},
+        {"next",  next_fit},
+        {"best",  best_fit},
+        {"good",  good_fit},
+};
+
+static void *(*find_fit)(size_t size) = first_fit;
+
+/*
+ * select_fit - point find_fit at the policy named by the MM_FIT
+ *     environment variable, or by the compile-time MM_FIT default
+ */
+static void select_fit(void) {
+    const char *name = getenv("MM_FIT");
+    int i, n = sizeof(fit_policies) / sizeof(fit_policies[0]);
+
+    if (name == NULL)
+        name = MM_FIT;
+    for (i = 0; i < n; i++) {
+        if (!strcmp(name, fit_policies[i].name)) {
+            find_fit = fit_policies[i].fit;
+            return;
+        }
+    }
+    fprintf(stderr, "mm_init: unknown fit policy %s, using first fit\n", name);
+    find_fit = first_fit;
+}
+
+/*
+ * flush_quick - coalesce every block on quick list i. Returns the first
+ *     coalesced block of at least size bytes, or fit if there is none;
+ *     fit is kept pointing at the start of the block that contains it.
+ */
+static char *flush_quick(int i, size_t size, char *fit) {
+    char *bp, *next;
+    size_t bsize;
+
+    STAT(stats.quick_flushes++);
+    for (bp = quick[i]; bp != NULL; bp = next) {
+        next = QUICK_NEXT(bp);
+        bsize = GET_SIZE(HDRP(bp));
+        PUT(HDRP(bp), PACK(bsize, 0));
+        PUT(FTRP(bp), PACK(bsize, 0));
+        bp = coalesce(bp);
+        if (fit >= bp && fit < NEXT_BLKP(bp))
+            fit = bp;
+        else if (fit == NULL && GET_SIZE(HDRP(bp)) >= size)
+            fit = bp;
+    }
+    quick[i] = NULL;
+    quick_len[i] = 0;
+    return fit;
+}
+
+/*
+ * flush_all_quick - coalesce the blocks on every quick list, and return
+ *     one of the resulting free blocks of at least size bytes, if any
+ */
+static char *flush_all_quick(size_t size) {
+    char *fit = NULL;
+    int i;
+
+    for (i = 0; i < QUICK_LISTS; i++)
+        if (quick[i] != NULL)
+            fit = flush_quick(i, size, fit);
+    return fit;
+}
+
+/*
+ * adjust_size - block size for a request of size payload bytes: the
+ *     payload plus header, footer and guard, aligned, and at least
+ *     MIN_BLOCK
+ */
+static size_t adjust_size(size_t size) {
+    return MAX(MIN_BLOCK, ALIGN(size + DSIZE + GUARD_SIZE));
+}
+
 static void place(void *bp, size_t size) {
     size_t ori_size = GET_SIZE(HDRP(bp));
     if (size < ori_size) {
+        STAT(stats.splits++);
         int is_last_blk = IS_LAST_BLK(NEXT_BLKP(NEXT_BLKP(bp)));
         PUT(HDRP(bp), PACK(size, 1));
         PUT(FTRP(bp), PACK(size, 1));
@@ -185,31 +489,169 @@ static void place(void *bp, size_t size) {
 }
 
 
+/*
+ * block_error - return what is wrong with the allocated block bp, or
+ *     NULL if its header, footer and (in debug mode) guard are intact
+ */
+static const char *block_error(char *bp) {
+    size_t hdr, size;
+#if MM_DEBUG
+    size_t *tail, req;
+    char *p;
+#endif
+
+    if ((size_t) bp % ALIGNMENT)
+        return "misaligned pointer";
+    if (!mem_owns(HDRP(bp), bp))
+        return "pointer outside the heap";
+    hdr = GET(HDRP(bp));
+    size = GET_SIZE(HDRP(bp));
+    if (!(hdr & 0x1))
+        return "block is not allocated";
+    if (hdr & 0x4)
+        return "double free";
+    if (size < MIN_BLOCK || size % ALIGNMENT)
+        return "corrupt header";
+    if (hdr & 0x2) {
+        if (!mem_owns(bp, (char *) bp + size - DSIZE - 1))
+            return "corrupt header";
+    } else {
+        if (!mem_owns(bp, FTRP(bp) + WSIZE - 1))
+            return "corrupt header";
+        if (GET(FTRP(bp)) != hdr)
+            return "header and footer differ";
+    }
+#if MM_DEBUG
+    tail = TAILP(bp);
+    req = tail[0];
+    if (tail[1] != (CANARY ^ req ^ (size_t) bp) || req > (size_t) ((char *) tail - bp))
+        return "canary overwritten past the payload";
+    for (p = bp + req; p < (char *) tail; p++)
+        if (*(unsigned char *) p != GUARD_BYTE)
+            return "payload overflow into the guard";
+#endif
+    return NULL;
+}
+
+#if MM_DEBUG
+/*
+ * guard_fail - report a corrupt block or a bad pointer, and abort
+ */
+static void guard_fail(void *bp, const char *what) {
+    fprintf(stderr, "mm: %s at %p\n", what, bp);
+    abort();
+}
+
+/*
+ * arm_guard - record the requested size and the canary after the
+ *     payload of the new block bp, and fill the slack between them
+ */
+static void arm_guard(char *bp, size_t size) {
+    size_t *tail = TAILP(bp);
+
+    memset(bp + size, GUARD_BYTE, (char *) tail - (bp + size));
+    tail[0] = size;
+    tail[1] = CANARY ^ size ^ (size_t) bp;
+}
+
+/*
+ * poison_len - bytes poisoned in a quarantined block, after its link
+ */
+static size_t poison_len(char *bp) {
+    size_t len = FTRP(bp) - (bp + sizeof(char *));
+    return len < POISON_MAX ? len : POISON_MAX;
+}
+
+/*
+ * poison_error - return what is wrong with the quarantined block bp,
+ *     or NULL if its poison is intact
+ */
+static const char *poison_error(char *bp) {
+    unsigned char *p = (unsigned char *) bp + sizeof(char *);
+    size_t i, len = poison_len(bp);
+
+    if (!GET_QUICK(HDRP(bp)) || GET(HDRP(bp)) != GET(FTRP(bp)))
+        return "corrupt header in quarantine";
+    for (i = 0; i < len; i++)
+        if (p[i] != POISON_BYTE)
+            return "write after free";
+    return NULL;
+}
+
+/*
+ * quarantine - poison the freed block bp and append it to the
+ *     quarantine. Once the quarantine holds too much, the oldest block
+ *     leaves it: its poison is checked and it is returned, to be freed
+ *     for real. Otherwise returns NULL.
+ */
+static char *quarantine(char *bp) {
+    size_t size = GET_SIZE(HDRP(bp));
+    const char *err;
+    char *old;
+
+    PUT(HDRP(bp), PACK(size, 0x5));
+    PUT(FTRP(bp), PACK(size, 0x5));
+    memset(bp + sizeof(char *), POISON_BYTE, poison_len(bp));
+    QUICK_NEXT(bp) = NULL;
+    if (q_tail != NULL)
+        QUICK_NEXT(q_tail) = bp;
+    else
+        q_head = bp;
+    q_tail = bp;
+    q_count++;
+    q_bytes += size;
+    if (q_count <= QUARANTINE_BLOCKS && q_bytes <= QUARANTINE_BYTES)
+        return NULL;
+
+    old = q_head;
+    if ((q_head = QUICK_NEXT(old)) == NULL)
+        q_tail = NULL;
+    q_count--;
+    q_bytes -= GET_SIZE(HDRP(old));
+    if ((err = poison_error(old)) != NULL)
+        guard_fail(old, err);
+    return old;
+}
+#endif
+
 /*
  * mm_init - initialize the malloc package.
  */
 int mm_init(void) {
-    /* initial empty heap */
-    if ((heap_listp = mem_sbrk(4 * WSIZE)) == (void *) -1)
+    /*
+     * initial empty heap: padding, then an ALIGNMENT-byte prologue
+     * block whose payload starts ALIGNMENT bytes into the heap, then
+     * the epilogue header
+     */
+    if ((heap_listp = mem_sbrk(2 * ALIGNMENT)) == (void *) -1)
         return -1;
-    PUT(heap_listp, 0); /* alignment padding */
-    PUT(heap_listp + (1 * WSIZE), PACK(DSIZE, 1)); /* Prologue header */
-    PUT(heap_listp + (2 * WSIZE), PACK(DSIZE, 1)); /* Prologue footer */
-    PUT(heap_listp + (3 * WSIZE), PACK(0, 1)); /* Epilogue footer */
-    heap_listp += (2 * WSIZE);
+    heap_listp += ALIGNMENT;
+    PUT(HDRP(heap_listp), PACK(ALIGNMENT, 1)); /* Prologue header */
+    PUT(FTRP(heap_listp), PACK(ALIGNMENT, 1)); /* Prologue footer */
+    PUT(HDRP(NEXT_BLKP(heap_listp)), PACK(0, 1)); /* Epilogue header */
+    rover = heap_listp;
+    memset(quick, 0, sizeof(quick));
+    memset(quick_len, 0, sizeof(quick_len));
+#if MM_DEBUG
+    q_head = q_tail = NULL;
+    q_count = 0;
+    q_bytes = 0;
+#endif
+    select_fit();
     dbg("heap_listp: %p\n", heap_listp);
+    STAT(memset(&stats, 0, sizeof(stats)));
 
-    if (extend_heap(CHUNKSIZE / WSIZE) == NULL)
+    if (extend_heap(chunk_size(CHUNKSIZE) / WSIZE) == NULL)
         return -1;
     dbg("extend heap success!\n");
     return 0;
 }
 
-/* 
- * mm_malloc - Allocate a block by incrementing the brk pointer.
- *     Always allocate a block whose size is a multiple of the alignment.
+/*
+ * malloc_block - Allocate a block from its own mapping, a quick list,
+ *     a fitting free block or a new heap chunk, in that order.
  */
-void *mm_malloc(size_t size) {
+static void *malloc_block(size_t size) {
     size_t adjsize; /* adjusted block size */
     size_t extsize; /* extend heap size if no fit */
     char *bp;
@@ -218,16 +660,26 @@ void *mm_malloc(size_t size) {
 
     if (size == 0) return NULL;
 
-    if (size <= DSIZE) /* alignment */
-        adjsize = 2 * DSIZE;
-    else /* alignment + header + footer */
-        adjsize = DSIZE * ((size + (DSIZE) + (DSIZE - 1)) / DSIZE);
+    adjsize = adjust_size(size);
 
-    if ((bp = find_fit(adjsize)) != NULL) {
+    if (adjsize >= MMAP_THRESHOLD)
+        return map_block(adjsize);
+
+    if (adjsize <= QUICK_MAX && (bp = quick[QUICK_IDX(adjsize)]) != NULL) {
+        quick[QUICK_IDX(adjsize)] = QUICK_NEXT(bp);
+        quick_len[QUICK_IDX(adjsize)]--;
+        PUT(HDRP(bp), PACK(adjsize, 1));
+        PUT(FTRP(bp), PACK(adjsize, 1));
+        STAT(stats.quick_hits++);
+        return bp;
+    }
+
+    if ((bp = find_fit(adjsize)) != NULL ||
+        (bp = flush_all_quick(adjsize)) != NULL) {
         place(bp, adjsize);
         return bp;
     }
-    extsize = MAX(adjsize, CHUNKSIZE);
+    extsize = chunk_size(adjsize);
     if ((bp = extend_heap(extsize / WSIZE)) == NULL)
         return NULL;
     place(bp, adjsize);
@@ -235,26 +687,99 @@ void *mm_malloc(size_t size) {
 }
 
 /*
- * mm_free - Freeing a block does nothing.
+ * mm_malloc - Allocate a block whose payload holds at least size bytes,
+ *     guarded in debug mode
  */
-void mm_free(void *ptr) {
+void *mm_malloc(size_t size) {
+    char *bp = malloc_block(size);
+
+#if MM_DEBUG
+    if (bp != NULL)
+        arm_guard(bp, size);
+#endif
+    return bp;
+}
+
+/*
+ * free_block - Unmap a mapped block, push a small block on its quick list,
+ *     or coalesce a heap block with its free neighbours and trim the heap
+ *     if it ends in a large free block. A full quick list is flushed.
+ */
+static void free_block(void *ptr) {
     size_t size = GET_SIZE(HDRP(ptr));
+    int i;
+
+    if (GET_MAPPED(HDRP(ptr))) {
+        mem_unmap((char *) ptr - MAP_PAD, size - DSIZE + MAP_PAD);
+        return;
+    }
+    if (size <= QUICK_MAX) {
+        i = QUICK_IDX(size);
+        if (quick_len[i] < QUICK_LIMIT) {
+            PUT(HDRP(ptr), PACK(size, 0x5));
+            PUT(FTRP(ptr), PACK(size, 0x5));
+            QUICK_NEXT(ptr) = quick[i];
+            quick[i] = ptr;
+            quick_len[i]++;
+            return;
+        }
+        flush_quick(i, 0, NULL);
+    }
     PUT(HDRP(ptr), PACK(size, 0));
     PUT(FTRP(ptr), PACK(size, 0));
-    coalesce(ptr);
+    trim_heap(coalesce(ptr));
     dbg("mm_free %zu success!\n", size);
 }
 
+/*
+ * mm_free - Free a block. In debug mode the block is checked first, and
+ *     a heap block goes through the quarantine before it is reused.
+ */
+void mm_free(void *ptr) {
+#if MM_DEBUG
+    const char *err;
+
+    if ((err = block_error(ptr)) != NULL)
+        guard_fail(ptr, err);
+    if (!GET_MAPPED(HDRP(ptr)) && (ptr = quarantine(ptr)) == NULL)
+        return;
+#endif
+    free_block(ptr);
+}
+
 
+/*
+ * mm_realloc - Resize mapped blocks in place with mem_remap, otherwise
+ *     allocate a new block, copy the payload and free the old block.
+ */
 void *mm_realloc(void *ptr, size_t size) {
     void *oldptr = ptr;
     void *newptr;
     size_t copySize;
+    size_t adjsize = adjust_size(size);
+#if MM_DEBUG
+    const char *err;
+
+    if ((err = block_error(oldptr)) != NULL)
+        guard_fail(oldptr, err);
+#endif
+
+    if (GET_MAPPED(HDRP(oldptr)) && adjsize >= MMAP_THRESHOLD) {
+        newptr = mem_remap((char *) oldptr - MAP_PAD, adjsize - DSIZE + MAP_PAD);
+        if (newptr == NULL)
+            return NULL;
+        newptr = (char *) newptr + MAP_PAD;
+        PUT(HDRP(newptr), PACK(adjsize, 0x3));
+#if MM_DEBUG
+        arm_guard(newptr, size);
+#endif
+        return newptr;
+    }
 
     newptr = mm_malloc(size);
     if (newptr == NULL)
         return NULL;
-    copySize = GET_SIZE(HDRP(oldptr));
+    copySize = GET_SIZE(HDRP(oldptr)) - DSIZE - GUARD_SIZE; /* payload of heap or mapped block */
     if (size < copySize)
         copySize = size;
     memcpy(newptr, oldptr, copySize);
@@ -263,16 +788,128 @@ void *mm_realloc(void *ptr, size_t size) {
 }
 
 
+/*
+ * check_fail - report one inconsistency found by mm_check
+ */
+static int check_fail(void *bp, const char *what) {
+    fprintf(stderr, "mm_check: %s at %p\n", what, bp);
+    return 1;
+}
 
+/*
+ * mm_check - walk the heap, the quick lists and (in debug mode) the
+ *     quarantine, and report every inconsistency on stderr: bad block
+ *     sizes, headers that differ from their footers, free blocks that
+ *     escaped coalescing, broken guards and poison, list entries that
+ *     are not marked quick or have the wrong size, and quick blocks on
+ *     no list. Returns the number of problems found.
+ */
+int mm_check(void) {
+    char *bp, *lo = mem_heap_lo(), *end = (char *) mem_heap_hi() + 1;
+    const char *err;
+    size_t size, marked = 0, listed = 0;
+    int i, n, prev_free = 0, errors = 0;
+
+    if (GET(HDRP(heap_listp)) != PACK(ALIGNMENT, 1) ||
+        GET(FTRP(heap_listp)) != PACK(ALIGNMENT, 1))
+        errors += check_fail(heap_listp, "corrupt prologue");
+
+    for (bp = NEXT_BLKP(heap_listp); GET_SIZE(HDRP(bp)) > 0; bp = NEXT_BLKP(bp)) {
+        size = GET_SIZE(HDRP(bp));
+        /* place may split off free fragments of just a header and footer */
+        if (size < ALIGN(DSIZE) || size % ALIGNMENT || bp + size > end)
+            return errors + check_fail(bp, "bad block size, heap walk stopped");
+        if (GET(HDRP(bp)) != GET(FTRP(bp)))
+            errors += check_fail(bp, "header and footer differ");
+        if (GET_MAPPED(HDRP(bp)))
+            errors += check_fail(bp, "mapped bit set on a heap block");
+        if (!GET_ALLOC(HDRP(bp))) {
+            if (prev_free)
+                errors += check_fail(bp, "free block escaped coalescing");
+        } else if (GET_QUICK(HDRP(bp)))
+            marked++;
+        else if ((err = block_error(bp)) != NULL)
+            errors += check_fail(bp, err);
+        prev_free = !GET_ALLOC(HDRP(bp));
+    }
+    if (HDRP(bp) != end - WSIZE || GET(HDRP(bp)) != PACK(0, 1))
+        errors += check_fail(bp, "corrupt epilogue");
+
+    for (i = 0; i < QUICK_LISTS; i++) {
+        size = MIN_BLOCK + (size_t) i * ALIGNMENT;
+        for (n = 0, bp = quick[i]; bp != NULL && n <= quick_len[i];
+             n++, bp = QUICK_NEXT(bp)) {
+            if (bp < lo || bp >= end || !GET_QUICK(HDRP(bp)) ||
+                GET_SIZE(HDRP(bp)) != size) {
+                errors += check_fail(bp, "bad block on a quick list");
+                break;
+            }
+        }
+        if (n != quick_len[i])
+            errors += check_fail(quick[i], "quick list length is wrong");
+        listed += n;
+    }
+#if MM_DEBUG
+    for (n = 0, bp = q_head; bp != NULL && n <= q_count; n++, bp = QUICK_NEXT(bp)) {
+        if (bp < lo || bp >= end) {
+            errors += check_fail(bp, "bad block in quarantine");
+            break;
+        }
+        if ((err = poison_error(bp)) != NULL)
+            errors += check_fail(bp, err);
+    }
+    if (n != q_count)
+        errors += check_fail(q_head, "quarantine length is wrong");
+    listed += n;
+#endif
+    if (listed != marked)
+        errors += check_fail(heap_listp, "quick blocks on no list");
+    return errors;
+}
 
+/*
+ * mm_get_stats - copy the counters kept since the last mm_init into *st.
+ *     Returns -1 if mm.c was built without MM_STATS.
+ */
+int mm_get_stats(mm_stats_t *st) {
+#if MM_STATS
+    *st = stats;
+    return 0;
+#else
+    return -1;
+#endif
+}
 
+/*
+ * mm_frag - external fragmentation of the heap: the fraction of the
+ *     free bytes that lie outside the largest free block. Blocks on the
+ *     quick lists count as free.
+ */
+double mm_frag(void) {
+    void *bp;
+    size_t size, free_bytes = 0, largest = 0;
+
+    for (bp = heap_listp; GET_SIZE(HDRP(bp)) > 0; bp = NEXT_BLKP(bp)) {
+        if (GET_ALLOC(HDRP(bp)) && !GET_QUICK(HDRP(bp)))
+            continue;
+        size = GET_SIZE(HDRP(bp));
+        free_bytes += size;
+        largest = MAX(largest, size);
+    }
+    return free_bytes ? 1.0 - (double) largest / free_bytes : 0.0;
+}
 
-
-
-
-
-
-
-
-
-
+/*
+ * mm_heapmap - write one CSV line per heap block, in address order:
+ *     tracenum, opnum, offset of the block from the heap start, size
+ *     and allocated bit, which is 0 for blocks on the quick lists
+ */
+void mm_heapmap(FILE *f, int tracenum, int opnum) {
+    void *bp;
+
+    for (bp = heap_listp; GET_SIZE(HDRP(bp)) > 0; bp = NEXT_BLKP(bp))
+        fprintf(f, "%d,%d,%ld,%lu,%d\n", tracenum, opnum,
+                (long) ((char *) bp - (char *) mem_heap_lo()),
+                (unsigned long) GET_SIZE(HDRP(bp)),
+                GET_ALLOC(HDRP(bp)) && !GET_QUICK(HDRP(bp)));
+}
@@ -5,6 +5,33 @@ extern void *mm_malloc(size_t size);
 extern void mm_free(void *ptr);
 extern void *mm_realloc(void *ptr, size_t size);
 
+/* Check the heap for consistency; returns the number of problems found */
+extern int mm_check(void);
+
+/*
+ * Counters of the work done inside mm.c since the last mm_init. They
+ * are only kept when mm.c is built with MM_STATS set to 1; otherwise
+ * mm_get_stats returns -1 and the allocator pays nothing for them.
+ */
+typedef struct {
+    unsigned long fit_calls;     /* calls to find_fit */
+    unsigned long fit_scanned;   /* blocks examined by those calls */
+    unsigned long fit_misses;    /* calls that found no fitting block */
+    unsigned long splits;        /* free blocks split by place */
+    unsigned long coalesce[4];   /* coalesce calls, by case 1 to 4 */
+    unsigned long extends;       /* calls to extend_heap */
+    unsigned long extend_bytes;  /* bytes added to the heap by them */
+    unsigned long trims;         /* times the heap tail was trimmed */
+    unsigned long trim_bytes;    /* bytes given back by those trims */
+    unsigned long maps;          /* blocks given their own mapping */
+    unsigned long quick_hits;    /* mallocs served from a quick list */
+    unsigned long quick_flushes; /* quick lists coalesced in a batch */
+} mm_stats_t;
+
+extern int mm_get_stats(mm_stats_t *stats);
+extern double mm_frag(void);
+extern void mm_heapmap(FILE *f, int tracenum, int opnum);
+
 
 /* 
  * Students work in teams of one or two.  Teams enter their team name, 
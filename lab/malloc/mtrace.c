@@ -0,0 +1,188 @@
+/*
+ * mtrace.c - LD_PRELOAD shim that records the allocation profile of a
+ *     real program, for turning into an mdriver trace with gentrace -R.
+ *
+ * usage: LD_PRELOAD=./libmtrace.so MTRACE_OUT=prog.prof prog args...
+ *
+ * Every malloc, calloc, realloc and free call is appended to MTRACE_OUT
+ * (default "mtrace.prof") as a profrec_t. Calls made from inside the
+ * shim itself, e.g. by dlsym, are passed through without being recorded.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dlfcn.h>
+#include <pthread.h>
+
+#include "tracefmt.h"
+
+#define NRECS 4096           /* records buffered before each write */
+#define BOOTSTRAP 8192       /* bytes handed out while dlsym runs */
+
+static void *(*real_malloc)(size_t);
+static void *(*real_calloc)(size_t, size_t);
+static void *(*real_realloc)(void *, size_t);
+static void (*real_free)(void *);
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static profrec_t recs[NRECS];
+static int nrecs = 0;
+static int fd = -1;
+static __thread int in_shim = 0;
+
+static char bootstrap[BOOTSTRAP];
+static size_t bootstrap_used = 0;
+
+/* function prototypes */
+static void *bootstrap_alloc(size_t nmemb, size_t size);
+static void flush(void);
+static void record(uint64_t op, void *ptr, void *newptr, size_t size);
+
+/*
+ * mtrace_init - look up the libc allocator and open the profile
+ */
+__attribute__((constructor))
+static void mtrace_init(void) {
+    const char *path = getenv("MTRACE_OUT");
+
+    in_shim = 1;
+    real_malloc = dlsym(RTLD_NEXT, "malloc");
+    real_calloc = dlsym(RTLD_NEXT, "calloc");
+    real_realloc = dlsym(RTLD_NEXT, "realloc");
+    real_free = dlsym(RTLD_NEXT, "free");
+    fd = open(path ? path : "mtrace.prof", O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    in_shim = 0;
+}
+
+/*
+ * mtrace_fini - write out the records still in the buffer
+ */
+__attribute__((destructor))
+static void mtrace_fini(void) {
+    pthread_mutex_lock(&lock);
+    flush();
+    if (fd >= 0)
+        close(fd);
+    fd = -1;
+    pthread_mutex_unlock(&lock);
+}
+
+void *malloc(size_t size) {
+    void *p;
+
+    if (real_malloc == NULL) {
+        /* dlsym itself may call malloc before we know the real one */
+        if (in_shim)
+            return bootstrap_alloc(1, size);
+        mtrace_init();
+    }
+    p = real_malloc(size);
+    if (!in_shim)
+        record(TRACE_ALLOC, p, NULL, size);
+    return p;
+}
+
+void *calloc(size_t nmemb, size_t size) {
+    void *p;
+
+    if (real_calloc == NULL) {
+        /* dlsym itself may call calloc before we know the real one */
+        return bootstrap_alloc(nmemb, size);
+    }
+    p = real_calloc(nmemb, size);
+    if (!in_shim)
+        record(TRACE_ALLOC, p, NULL, nmemb * size);
+    return p;
+}
+
+void *realloc(void *ptr, size_t size) {
+    void *p;
+
+    if (real_realloc == NULL && !in_shim)
+        mtrace_init();
+    if (real_realloc == NULL ||
+        ((char *) ptr >= bootstrap && (char *) ptr < bootstrap + BOOTSTRAP)) {
+        /* move a bootstrap block to the real heap, or to a new bootstrap
+           block while dlsym is still running */
+        if ((p = malloc(size)) != NULL && ptr != NULL)
+            memcpy(p, ptr, size < (size_t) (bootstrap + BOOTSTRAP - (char *) ptr) ?
+                           size : (size_t) (bootstrap + BOOTSTRAP - (char *) ptr));
+        return p;
+    }
+    p = real_realloc(ptr, size);
+    if (!in_shim)
+        record(TRACE_REALLOC, ptr, p, size);
+    return p;
+}
+
+void free(void *ptr) {
+    if ((char *) ptr >= bootstrap && (char *) ptr < bootstrap + BOOTSTRAP)
+        return;
+    if (real_free == NULL) {
+        if (in_shim)
+            return;  /* only bootstrap blocks exist yet */
+        mtrace_init();
+    }
+    if (!in_shim && ptr != NULL)
+        record(TRACE_FREE, ptr, NULL, 0);
+    real_free(ptr);
+}
+
+/*
+ * bootstrap_alloc - hand out zeroed space for nmemb * size bytes from
+ *     the bootstrap buffer, for calls made while dlsym runs. The space
+ *     is never reused. Returns NULL on overflow or once it is used up.
+ */
+static void *bootstrap_alloc(size_t nmemb, size_t size) {
+    void *p;
+
+    if (size != 0 && nmemb > (BOOTSTRAP - bootstrap_used) / size)
+        return NULL;
+    size = (nmemb * size + 15) & ~(size_t) 15;
+    if (bootstrap_used + size > BOOTSTRAP)
+        return NULL;
+    p = bootstrap + bootstrap_used;
+    bootstrap_used += size;
+    return p;
+}
+
+/*
+ * record - append one call to the profile buffer
+ */
+static void record(uint64_t op, void *ptr, void *newptr, size_t size) {
+    profrec_t *r;
+
+    in_shim = 1;
+    pthread_mutex_lock(&lock);
+    if (fd >= 0) {
+        r = &recs[nrecs++];
+        r->op = op;
+        r->ptr = (uint64_t) (uintptr_t) ptr;
+        r->newptr = (uint64_t) (uintptr_t) newptr;
+        r->size = size;
+        if (nrecs == NRECS)
+            flush();
+    }
+    pthread_mutex_unlock(&lock);
+    in_shim = 0;
+}
+
+/*
+ * flush - write the buffered records; the caller holds lock
+ */
+static void flush(void) {
+    char *buf = (char *) recs;
+    size_t left = nrecs * sizeof(profrec_t);
+    ssize_t n;
+
+    while (fd >= 0 && left > 0) {
+        if ((n = write(fd, buf, left)) <= 0)
+            break;
+        buf += n;
+        left -= n;
+    }
+    nrecs = 0;
+}
@@ -0,0 +1,95 @@
+/*
+ * perfctr.c - Count hardware events incurred by a function f
+ *
+ * Uses the Linux perf_event_open interface to count the data TLB
+ * misses (loads and stores) of the calling thread while f(argp) runs.
+ * The counters are unavailable on some virtual machines and when
+ * kernel.perf_event_paranoid forbids them, in which case every
+ * measurement returns -1.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "perfctr.h"
+
+/* file descriptors of the dTLB load and store miss counters */
+static int load_fd = -1;
+static int store_fd = -1;
+
+/* function prototypes */
+static int open_counter(unsigned long long op);
+static long long read_counter(int fd);
+
+/*
+ * init_perfctr - open the dTLB miss counters for the calling thread
+ */
+int init_perfctr(void) {
+    load_fd = open_counter(PERF_COUNT_HW_CACHE_OP_READ);
+    store_fd = open_counter(PERF_COUNT_HW_CACHE_OP_WRITE);
+    if (load_fd < 0) {
+        fprintf(stderr, "init_perfctr: dTLB miss counter unavailable\n");
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * perfctr_dtlb_misses - run f(argp) once with the counters enabled and
+ *    return the number of dTLB misses, or -1 if there are no counters
+ */
+double perfctr_dtlb_misses(perfctr_test_funct f, void *argp) {
+    long long misses;
+
+    if (load_fd < 0)
+        return -1;
+
+    ioctl(load_fd, PERF_EVENT_IOC_RESET, 0);
+    if (store_fd >= 0)
+        ioctl(store_fd, PERF_EVENT_IOC_RESET, 0);
+    ioctl(load_fd, PERF_EVENT_IOC_ENABLE, 0);
+    if (store_fd >= 0)
+        ioctl(store_fd, PERF_EVENT_IOC_ENABLE, 0);
+
+    f(argp);
+
+    ioctl(load_fd, PERF_EVENT_IOC_DISABLE, 0);
+    if (store_fd >= 0)
+        ioctl(store_fd, PERF_EVENT_IOC_DISABLE, 0);
+
+    misses = read_counter(load_fd);
+    if (store_fd >= 0)
+        misses += read_counter(store_fd);
+    return (double) misses;
+}
+
+/*
+ * open_counter - open a disabled user-space dTLB miss counter for op
+ */
+static int open_counter(unsigned long long op) {
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HW_CACHE;
+    attr.size = sizeof(attr);
+    attr.config = PERF_COUNT_HW_CACHE_DTLB | (op << 8) |
+                  (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return (int) syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+/*
+ * read_counter - return the current value of counter fd
+ */
+static long long read_counter(int fd) {
+    long long count;
+
+    if (read(fd, &count, sizeof(count)) != sizeof(count))
+        return 0;
+    return count;
+}
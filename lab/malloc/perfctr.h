@@ -0,0 +1,10 @@
+/*
+ * Hardware event counters
+ */
+typedef void (*perfctr_test_funct)(void *);
+
+/* Open the dTLB miss counter. Return 0 on success, -1 if unavailable */
+int init_perfctr(void);
+
+/* Count the dTLB misses incurred by one run of f(argp), or -1 */
+double perfctr_dtlb_misses(perfctr_test_funct f, void *argp);
@@ -0,0 +1,223 @@
+/*
+ * slab.c - A slab allocator for fixed-size objects, layered over memlib.
+ *
+ * A cache serves objects of a single size. It grows by carving a slab
+ * of slab_bytes (a power of two, at least a page) from mem_sbrk,
+ * aligned to slab_bytes. The slab starts with a small header and a
+ * bitmap with one bit per object, set while the object is free; the
+ * objects follow. Since slabs are aligned to their size, slab_free
+ * finds the slab of an object by masking its address, so objects
+ * carry no header at all.
+ *
+ * Slabs with at least one free object are kept on a doubly linked
+ * partial list; slab_alloc takes the first free bit of the first
+ * partial slab, and each slab remembers the lowest bitmap word that
+ * may have a free bit. Both operations are O(1) for a given cache.
+ * A slab that becomes empty while its cache has other partial slabs
+ * goes to a pool of empty slabs of its size, shared by all caches,
+ * which new_slab draws from before growing the heap. The padding that
+ * aligns a new slab is cut into smaller aligned pieces. Pieces of a
+ * page or more go to the pools, but only a cache whose slabs have that
+ * exact size will use them. Pieces under a page can hold no slab, so
+ * they are lost. The loss is under a page each time the heap grows
+ * from a break that is not page-aligned. That happens at the start of
+ * a heap that memlib got from malloc rather than mmap, or after other
+ * users of memlib have moved the break. Slabs are never returned to
+ * memlib.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "slab.h"
+#include "memlib.h"
+#include "config.h"
+
+#define SLAB_MIN_OBJS 8    /* grow slabs until they hold this many objects */
+#define MAP_BITS (8 * (int) sizeof(unsigned long))
+#define POOLS 32           /* one empty slab pool per power of two size */
+
+/* rounds up to the nearest multiple of ALIGNMENT */
+#define ALIGN(size) (((size) + (ALIGNMENT-1)) & ~(size_t) (ALIGNMENT-1))
+
+/* The header at the start of every slab */
+typedef struct slab {
+    struct slab *next;     /* next slab on the partial list */
+    struct slab *prev;     /* previous slab on the partial list */
+    int nfree;             /* free objects in this slab */
+    int hint;              /* no free bits in map words below this */
+    unsigned long map[];   /* one bit per object, set if it is free */
+} slab_t;
+
+struct slab_cache {
+    size_t size;           /* object size, a multiple of ALIGNMENT */
+    size_t slab_bytes;     /* size and alignment of each slab */
+    size_t first;          /* offset of the first object in a slab */
+    int nobjs;             /* objects per slab */
+    int nwords;            /* words in each slab's bitmap */
+    slab_t *partial;       /* slabs with free objects */
+};
+
+static slab_cache_t caches[SLAB_MAX_CACHES];
+static int num_caches = 0;
+static slab_t *empty[POOLS];   /* empty slabs of 2^i bytes, linked by next */
+
+/* function prototypes */
+static size_t header_size(int nobjs);
+static slab_t *new_slab(slab_cache_t *c);
+static int pool_of(size_t slab_bytes);
+
+/*
+ * slab_init - forget all caches. The caller resets the memlib heap.
+ */
+void slab_init(void) {
+    num_caches = 0;
+    memset(empty, 0, sizeof(empty));
+}
+
+/*
+ * slab_create - make a cache for objects of size bytes. Returns NULL
+ *     if there are already SLAB_MAX_CACHES caches.
+ */
+slab_cache_t *slab_create(size_t size) {
+    slab_cache_t *c;
+    int n;
+
+    if (num_caches == SLAB_MAX_CACHES || size == 0)
+        return NULL;
+    c = &caches[num_caches++];
+    c->size = ALIGN(size);
+    c->slab_bytes = mem_pagesize();
+    while ((c->slab_bytes - header_size(SLAB_MIN_OBJS)) / c->size < SLAB_MIN_OBJS)
+        c->slab_bytes *= 2;
+
+    /* fit as many objects as the bitmap for them leaves room for */
+    n = (int) ((c->slab_bytes - header_size(0)) / c->size);
+    while (header_size(n) + n * c->size > c->slab_bytes)
+        n--;
+    c->nobjs = n;
+    c->nwords = (n + MAP_BITS - 1) / MAP_BITS;
+    c->first = header_size(n);
+    c->partial = NULL;
+    return c;
+}
+
+/*
+ * slab_alloc - return a free object from cache c, or NULL if the heap
+ *     is exhausted
+ */
+void *slab_alloc(slab_cache_t *c) {
+    slab_t *s = c->partial;
+    unsigned long word;
+    int w, bit;
+
+    if (s == NULL && (s = new_slab(c)) == NULL)
+        return NULL;
+
+    for (w = s->hint; (word = s->map[w]) == 0; w++)
+        ;
+    s->hint = w;
+    bit = __builtin_ctzl(word);
+    s->map[w] = word & (word - 1);
+
+    /* a full slab leaves the partial list */
+    if (--s->nfree == 0) {
+        c->partial = s->next;
+        if (s->next)
+            s->next->prev = NULL;
+    }
+    return (char *) s + c->first + (size_t) (w * MAP_BITS + bit) * c->size;
+}
+
+/*
+ * slab_free - give object ptr back to cache c
+ */
+void slab_free(slab_cache_t *c, void *ptr) {
+    slab_t *s = (slab_t *) ((uintptr_t) ptr & ~(uintptr_t) (c->slab_bytes - 1));
+    int i = (int) (((char *) ptr - (char *) s - c->first) / c->size);
+    int w = i / MAP_BITS;
+
+    s->map[w] |= 1UL << (i % MAP_BITS);
+    if (w < s->hint)
+        s->hint = w;
+
+    /* a slab that was full goes back on the partial list */
+    if (s->nfree++ == 0) {
+        s->prev = NULL;
+        s->next = c->partial;
+        if (c->partial)
+            c->partial->prev = s;
+        c->partial = s;
+    }
+
+    /* an empty slab goes to the pool, unless it is the last partial one */
+    if (s->nfree == c->nobjs && (s->prev || s->next)) {
+        if (s->prev)
+            s->prev->next = s->next;
+        else
+            c->partial = s->next;
+        if (s->next)
+            s->next->prev = s->prev;
+        s->next = empty[pool_of(c->slab_bytes)];
+        empty[pool_of(c->slab_bytes)] = s;
+    }
+}
+
+/*
+ * header_size - bytes taken by the header and bitmap of a slab with
+ *     nobjs objects, rounded up so the first object is aligned
+ */
+static size_t header_size(int nobjs) {
+    int nwords = (nobjs + MAP_BITS - 1) / MAP_BITS;
+    return ALIGN(sizeof(slab_t) + nwords * sizeof(unsigned long));
+}
+
+/*
+ * new_slab - take an empty slab for cache c from the pool, or carve an
+ *     aligned one from the heap, mark all its objects free, and put it
+ *     on the partial list
+ */
+static slab_t *new_slab(slab_cache_t *c) {
+    char *brk = (char *) mem_heap_hi() + 1;
+    size_t pad = (c->slab_bytes - (uintptr_t) brk % c->slab_bytes) % c->slab_bytes;
+    int pool = pool_of(c->slab_bytes);
+    slab_t *s;
+    int w;
+
+    size_t chunk;
+
+    if ((s = empty[pool]) != NULL) {
+        empty[pool] = s->next;
+    } else {
+        if ((long) mem_sbrk((int) (pad + c->slab_bytes)) == -1)
+            return NULL;
+        for (; pad > 0; pad -= chunk, brk += chunk) {
+            chunk = (uintptr_t) brk & -(uintptr_t) brk;
+            if (chunk < mem_pagesize())
+                continue;  /* too small for any slab */
+            ((slab_t *) brk)->next = empty[pool_of(chunk)];
+            empty[pool_of(chunk)] = (slab_t *) brk;
+        }
+        s = (slab_t *) brk;
+    }
+    for (w = 0; w < c->nwords; w++)
+        s->map[w] = ~0UL;
+    if (c->nobjs % MAP_BITS)
+        s->map[c->nwords - 1] = (1UL << (c->nobjs % MAP_BITS)) - 1;
+    s->nfree = c->nobjs;
+    s->hint = 0;
+    s->prev = NULL;
+    s->next = c->partial;
+    if (c->partial)
+        c->partial->prev = s;
+    c->partial = s;
+    return s;
+}
+
+/*
+ * pool_of - index of the empty slab pool for slabs of slab_bytes
+ */
+static int pool_of(size_t slab_bytes) {
+    return __builtin_ctzl(slab_bytes);
+}
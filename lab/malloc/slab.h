@@ -0,0 +1,15 @@
+#include <stdio.h>
+
+/*
+ * Fixed-size object caches. Each cache hands out objects of one size
+ * from slabs carved out of the memlib heap, so the heap must not be
+ * shared with mm.c at the same time.
+ */
+#define SLAB_MAX_CACHES 16  /* caches that can exist between slab_inits */
+
+typedef struct slab_cache slab_cache_t;
+
+extern void slab_init(void);
+extern slab_cache_t *slab_create(size_t size);
+extern void *slab_alloc(slab_cache_t *cache);
+extern void slab_free(slab_cache_t *cache, void *ptr);
@@ -0,0 +1,76 @@
+/*
+ * trace2bin.c - Convert a text .rep trace into the binary trace format
+ *     described in tracefmt.h, so that mdriver can load it with mmap.
+ *
+ * usage: trace2bin <in.rep> <out.bin>
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "tracefmt.h"
+
+int main(int argc, char **argv) {
+    FILE *fp;
+    int sugg_heapsize, num_ids, num_ops, weight;
+    uint32_t *ops, *sizes;
+    unsigned index, size;
+    char type[2];
+    int i;
+
+    if (argc != 3) {
+        fprintf(stderr, "usage: %s <in.rep> <out.bin>\n", argv[0]);
+        exit(1);
+    }
+    if ((fp = fopen(argv[1], "r")) == NULL) {
+        perror(argv[1]);
+        exit(1);
+    }
+    if (fscanf(fp, "%d %d %d %d", &sugg_heapsize, &num_ids, &num_ops, &weight) != 4 ||
+        num_ops < 0 || num_ids < 0 || (unsigned) num_ids > TRACE_MAXID + 1u) {
+        fprintf(stderr, "%s: bad trace header\n", argv[1]);
+        exit(1);
+    }
+    ops = (uint32_t *) malloc(num_ops * sizeof(uint32_t));
+    sizes = (uint32_t *) malloc(num_ops * sizeof(uint32_t));
+    if (ops == NULL || sizes == NULL) {
+        fprintf(stderr, "%s: out of memory\n", argv[0]);
+        exit(1);
+    }
+
+    for (i = 0; i < num_ops; i++) {
+        size = 0;
+        if (fscanf(fp, "%1s %u", type, &index) != 2 ||
+            (type[0] != 'f' && fscanf(fp, "%u", &size) != 1) ||
+            index >= (unsigned) num_ids) {
+            fprintf(stderr, "%s: bad request on line %d\n", argv[1], i + 5);
+            exit(1);
+        }
+        switch (type[0]) {
+            case 'a':
+                ops[i] = TRACE_OP(TRACE_ALLOC, index);
+                break;
+            case 'r':
+                ops[i] = TRACE_OP(TRACE_REALLOC, index);
+                break;
+            case 'f':
+                ops[i] = TRACE_OP(TRACE_FREE, index);
+                break;
+            default:
+                fprintf(stderr, "%s: bogus type character (%c) on line %d\n",
+                        argv[1], type[0], i + 5);
+                exit(1);
+        }
+        sizes[i] = size;
+    }
+    fclose(fp);
+
+    if (write_binary_trace(argv[2], sugg_heapsize, num_ids, num_ops, weight,
+                           ops, sizes) < 0) {
+        perror(argv[2]);
+        exit(1);
+    }
+    free(ops);
+    free(sizes);
+    return 0;
+}
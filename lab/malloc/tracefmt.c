@@ -0,0 +1,87 @@
+/*
+ * tracefmt.c - Encoding helpers for the binary trace format (tracefmt.h)
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tracefmt.h"
+
+/*
+ * varint_encode - LEB128: 7 bits per byte, high bit set on all but the last
+ */
+int varint_encode(uint32_t v, unsigned char *buf) {
+    int n = 0;
+
+    while (v >= 0x80) {
+        buf[n++] = (unsigned char) (v | 0x80);
+        v >>= 7;
+    }
+    buf[n++] = (unsigned char) v;
+    return n;
+}
+
+/*
+ * varint_decode - inverse of varint_encode. The varint must end by end
+ *     and take at most 5 bytes; returns NULL if it does not.
+ */
+const unsigned char *varint_decode(const unsigned char *p,
+                                   const unsigned char *end, uint32_t *v) {
+    uint32_t val = 0;
+    int shift = 0;
+
+    do {
+        if (p == end || shift > 28)
+            return NULL;
+        val |= (uint32_t) (*p & 0x7f) << shift;
+        shift += 7;
+    } while (*p++ & 0x80);
+    *v = val;
+    return p;
+}
+
+/*
+ * write_binary_trace - write the header, op records, and size stream of
+ *     a trace to path. Returns 0 on success and -1 on any error.
+ */
+int write_binary_trace(const char *path, int sugg_heapsize, int num_ids,
+                       int num_ops, int weight,
+                       const uint32_t *ops, const uint32_t *sizes) {
+    FILE *fp;
+    tracehdr_t hdr;
+    unsigned char buf[5];
+    uint64_t sizes_bytes = 0;
+    int i, n;
+
+    /* The size stream goes last, so measure it before writing the header */
+    for (i = 0; i < num_ops; i++)
+        if (TRACE_OP_TYPE(ops[i]) != TRACE_FREE)
+            sizes_bytes += varint_encode(sizes[i], buf);
+
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic = TRACE_MAGIC;
+    hdr.version = TRACE_VERSION;
+    hdr.sugg_heapsize = sugg_heapsize;
+    hdr.num_ids = num_ids;
+    hdr.num_ops = num_ops;
+    hdr.weight = weight;
+    hdr.sizes_bytes = sizes_bytes;
+
+    if ((fp = fopen(path, "wb")) == NULL)
+        return -1;
+    if (fwrite(&hdr, sizeof(hdr), 1, fp) != 1 ||
+        fwrite(ops, sizeof(uint32_t), num_ops, fp) != (size_t) num_ops) {
+        fclose(fp);
+        return -1;
+    }
+    for (i = 0; i < num_ops; i++) {
+        if (TRACE_OP_TYPE(ops[i]) == TRACE_FREE)
+            continue;
+        n = varint_encode(sizes[i], buf);
+        if (fwrite(buf, 1, n, fp) != (size_t) n) {
+            fclose(fp);
+            return -1;
+        }
+    }
+    return fclose(fp);
+}
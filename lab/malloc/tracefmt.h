@@ -0,0 +1,62 @@
+/*
+ * tracefmt.h - Binary trace format shared by mdriver and the trace tools
+ *
+ * A binary trace is a tracehdr_t, followed by num_ops packed 32-bit op
+ * records, followed by a stream of LEB128 varints holding the byte size
+ * of every alloc and realloc request, in trace order. The header and
+ * op records are written in the byte order of the host, so a trace
+ * only reads back on hosts of the same endianness; elsewhere its magic
+ * does not match and mdriver takes it for a text trace. The op records
+ * start 8-byte aligned, so mdriver reads them straight from the mapped
+ * file while it decodes the trace into its own arrays.
+ */
+#include <stdint.h>
+
+#define TRACE_MAGIC   0x4352544d  /* "MTRC" */
+#define TRACE_VERSION 1
+
+/* Op record: request type in the top 2 bits, block id in the low 30 */
+#define TRACE_ALLOC   0
+#define TRACE_FREE    1
+#define TRACE_REALLOC 2
+#define TRACE_MAXID   ((1u << 30) - 1)
+#define TRACE_OP(type, id) (((uint32_t) (type) << 30) | (uint32_t) (id))
+#define TRACE_OP_TYPE(op)  ((op) >> 30)
+#define TRACE_OP_ID(op)    ((op) & TRACE_MAXID)
+
+typedef struct {
+    uint32_t magic;          /* TRACE_MAGIC */
+    uint32_t version;        /* TRACE_VERSION */
+    int32_t sugg_heapsize;   /* same four fields as a .rep header */
+    int32_t num_ids;
+    int32_t num_ops;
+    int32_t weight;
+    uint64_t sizes_bytes;    /* length of the varint size stream */
+} tracehdr_t;
+
+/*
+ * Allocation profile recorded by the libmtrace.so LD_PRELOAD shim: a
+ * flat array of profrec_t, one per malloc/calloc/realloc/free call of
+ * the traced program. gentrace -R turns a profile into a trace.
+ */
+typedef struct {
+    uint64_t op;             /* TRACE_ALLOC, TRACE_FREE or TRACE_REALLOC */
+    uint64_t ptr;            /* block returned by malloc, or block freed */
+    uint64_t newptr;         /* block returned by realloc */
+    uint64_t size;           /* requested size in bytes */
+} profrec_t;
+
+/* Encode v into buf (at least 5 bytes); return the bytes used */
+int varint_encode(uint32_t v, unsigned char *buf);
+
+/*
+ * Decode one varint at p, which must end by end, into *v. Returns the
+ * first byte after it, or NULL if it runs past end or over 5 bytes.
+ */
+const unsigned char *varint_decode(const unsigned char *p,
+                                   const unsigned char *end, uint32_t *v);
+
+/* Write a binary trace. sizes[i] is ignored for free requests */
+int write_binary_trace(const char *path, int sugg_heapsize, int num_ids,
+                       int num_ops, int weight,
+                       const uint32_t *ops, const uint32_t *sizes);
@@ -0,0 +1,315 @@
+/*
+ * tsc.c - Estimate the time (in seconds) used by a function f with the
+ *         time stamp counter
+ *
+ * The x86-64 replacement for fcyc.c and clock.c, which only know the
+ * 32-bit rdtsc. On CPUs with an invariant TSC the counter ticks at a
+ * constant rate regardless of frequency scaling and sleep states, so
+ * it is a wall clock with sub-nanosecond resolution once its rate is
+ * known. init_tsc measures that rate against CLOCK_MONOTONIC_RAW.
+ *
+ * To keep the numbers repeatable, init_tsc also pins the process to
+ * the CPU it is running on, so it is not migrated between cores in the
+ * middle of a run (unpin_tsc gives back the CPUs it had before, for
+ * multi-threaded runs), and warns when the cpufreq governor of that CPU is
+ * not "performance", since the core clock then varies from run to run
+ * even though the TSC does not. Without an invariant TSC (or off x86)
+ * it falls back to CLOCK_MONOTONIC_RAW, in nanoseconds.
+ *
+ * ftsc uses the same K-best scheme as fcyc: run f until the K fastest
+ * runs are within a factor of 1+epsilon of each other, or maxsamples
+ * runs have been made, and return the fastest.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <sched.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <x86intrin.h>
+#endif
+
+#include "tsc.h"
+
+/* Default values */
+#define K 3                  /* Value of K in K-best scheme */
+#define MAX_K 16             /* Largest K accepted by set_tsc_k */
+#define MAXSAMPLES 20        /* Give up after MAXSAMPLES */
+#define EPSILON 0.01         /* K samples should be EPSILON of each other */
+#define CALIB_ROUNDS 5       /* calibration rounds; the median is kept */
+#define CALIB_NSECS 20000000 /* length of each calibration round (20 ms) */
+
+static int kbest = K;
+static int maxsamples = MAXSAMPLES;
+static double epsilon = EPSILON;
+
+static int use_tsc = 0;      /* 1 if the invariant TSC is the time source */
+static double hz = 1e9;      /* ticks per second of the time source */
+
+static int pinned = 0;       /* 1 if pin_cpu changed the affinity mask */
+static cpu_set_t saved_set;  /* the affinity mask before pin_cpu */
+
+static uint64_t values[MAX_K]; /* the kbest fastest runs, fastest first */
+static int samplecount = 0;
+
+/* function prototypes */
+static int tsc_invariant(void);
+static uint64_t clock_ns(void);
+static double calibrate(void);
+static int pin_cpu(void);
+static void check_governor(int cpu, int verbose);
+static void add_sample(uint64_t val);
+static int has_converged(void);
+
+/*
+ * init_tsc - set up the timer and return its frequency in MHz
+ */
+double init_tsc(int verbose) {
+    int cpu = pin_cpu();
+
+    use_tsc = tsc_invariant();
+    if (use_tsc) {
+        hz = calibrate();
+        if (verbose)
+            printf("Measuring performance with the invariant TSC (%.1f MHz) "
+                   "on CPU %d.\n", hz / 1e6, cpu);
+    } else {
+        hz = 1e9;
+        if (verbose)
+            printf("No invariant TSC: measuring performance with "
+                   "CLOCK_MONOTONIC_RAW on CPU %d.\n", cpu);
+    }
+    if (cpu >= 0)
+        check_governor(cpu, verbose);
+    return hz / 1e6;
+}
+
+/*
+ * unpin_tsc - restore the CPU affinity mask the process had before
+ *     init_tsc pinned it. Threads created afterwards inherit the mask,
+ *     so call this before running anything multi-threaded.
+ */
+void unpin_tsc(void) {
+    if (pinned && sched_setaffinity(0, sizeof(saved_set), &saved_set) < 0)
+        fprintf(stderr, "Warning: could not restore the CPU affinity mask\n");
+    pinned = 0;
+}
+
+/*
+ * tsc_start - read the time source at the start of a measurement. The
+ *     lfence keeps rdtsc from running before earlier instructions.
+ */
+uint64_t tsc_start(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    if (use_tsc) {
+        _mm_lfence();
+        return __rdtsc();
+    }
+#endif
+    return clock_ns();
+}
+
+/*
+ * tsc_stop - read the time source at the end of a measurement. rdtscp
+ *     waits for earlier instructions, and the lfence keeps later ones
+ *     from starting before it.
+ */
+uint64_t tsc_stop(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    if (use_tsc) {
+        unsigned aux;
+        uint64_t t = __rdtscp(&aux);
+        _mm_lfence();
+        return t;
+    }
+#endif
+    return clock_ns();
+}
+
+/*
+ * tsc_hz - the rate of tsc_start and tsc_stop: the calibrated TSC
+ *     frequency, or 1e9 when they read CLOCK_MONOTONIC_RAW in ns
+ */
+double tsc_hz(void) {
+    return hz;
+}
+
+/*
+ * ftsc - Use K-best scheme to estimate the running time of function f
+ */
+double ftsc(tsc_test_funct f, void *argp) {
+    uint64_t start;
+
+    samplecount = 0;
+    do {
+        start = tsc_start();
+        f(argp);
+        add_sample(tsc_stop() - start);
+    } while (!has_converged() && samplecount < maxsamples);
+    return values[0] / hz;
+}
+
+/*
+ * tsc_invariant - is there a TSC that ticks at a constant rate in all
+ *     P- and C-states? (CPUID leaf 0x80000007, EDX bit 8)
+ */
+static int tsc_invariant(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    unsigned eax, ebx, ecx, edx;
+
+    if (!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx))
+        return 0;
+    return (edx >> 8) & 1;
+#else
+    return 0;
+#endif
+}
+
+/*
+ * clock_ns - read CLOCK_MONOTONIC_RAW, which NTP does not slew
+ */
+static uint64_t clock_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/*
+ * calibrate - count TSC ticks over CALIB_ROUNDS intervals of
+ *     CALIB_NSECS of CLOCK_MONOTONIC_RAW and return the median rate.
+ *     Each end of an interval reads the TSC between two clock reads,
+ *     and is pinned to the midpoint of the two.
+ */
+static double calibrate(void) {
+    double rates[CALIB_ROUNDS], tmp;
+    uint64_t c0, c1, c2, c3, t0, t1;
+    int i, j;
+
+    for (i = 0; i < CALIB_ROUNDS; i++) {
+        c0 = clock_ns();
+        t0 = tsc_start();
+        c1 = clock_ns();
+        do {
+            c2 = clock_ns();
+            t1 = tsc_stop();
+            c3 = clock_ns();
+        } while (c2 - c1 < CALIB_NSECS);
+        rates[i] = (t1 - t0) * 2e9 / (double) ((c2 + c3) - (c0 + c1));
+
+        /* insertion sort, so rates[0..i] stay in order */
+        for (j = i; j > 0 && rates[j - 1] > rates[j]; j--) {
+            tmp = rates[j - 1];
+            rates[j - 1] = rates[j];
+            rates[j] = tmp;
+        }
+    }
+    return rates[CALIB_ROUNDS / 2];
+}
+
+/*
+ * pin_cpu - bind the process to the CPU it is running on, saving the
+ *     old mask for unpin_tsc. Returns the CPU, or -1 if it could not be
+ *     pinned.
+ */
+static int pin_cpu(void) {
+    cpu_set_t set;
+    int cpu = sched_getcpu();
+
+    if (cpu < 0 || sched_getaffinity(0, sizeof(saved_set), &saved_set) < 0)
+        return -1;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (sched_setaffinity(0, sizeof(set), &set) < 0) {
+        fprintf(stderr, "Warning: could not pin to CPU %d\n", cpu);
+        return -1;
+    }
+    pinned = 1;
+    return cpu;
+}
+
+/*
+ * check_governor - warn if the cpufreq governor of cpu lets its clock
+ *     vary. Machines without cpufreq (most VMs) are left alone.
+ */
+static void check_governor(int cpu, int verbose) {
+    char path[128], gov[64];
+    FILE *fp;
+
+    sprintf(path, "/sys/devices/system/cpu/cpu%d/cpufreq/scaling_governor", cpu);
+    if ((fp = fopen(path, "r")) == NULL) {
+        if (verbose)
+            printf("No cpufreq governor on CPU %d.\n", cpu);
+        return;
+    }
+    if (fgets(gov, sizeof(gov), fp) == NULL)
+        gov[0] = '\0';
+    fclose(fp);
+    gov[strcspn(gov, "\n")] = '\0';
+
+    if (strcmp(gov, "performance") != 0)
+        fprintf(stderr, "Warning: CPU %d uses the \"%s\" cpufreq governor; "
+                "set it to \"performance\" for repeatable timings\n", cpu, gov);
+    else if (verbose)
+        printf("CPU %d uses the performance governor.\n", cpu);
+}
+
+/*
+ * add_sample - Add new sample, keeping the kbest smallest in order
+ */
+static void add_sample(uint64_t val) {
+    int pos;
+
+    if (samplecount < kbest)
+        pos = samplecount;
+    else if (val < values[kbest - 1])
+        pos = kbest - 1;
+    else {
+        samplecount++;
+        return;
+    }
+    for (; pos > 0 && values[pos - 1] > val; pos--)
+        values[pos] = values[pos - 1];
+    values[pos] = val;
+    samplecount++;
+}
+
+/*
+ * has_converged - Have kbest minimum measurements converged within epsilon?
+ */
+static int has_converged(void) {
+    return samplecount >= kbest &&
+           (1 + epsilon) * values[0] >= values[kbest - 1];
+}
+
+
+/*************************************************************
+ * Set the various parameters used by the measurement routines
+ ************************************************************/
+
+/*
+ * set_tsc_k - Value of K in K-best measurement scheme
+ *     Default = 3
+ */
+void set_tsc_k(int k) {
+    kbest = k < 1 ? 1 : k > MAX_K ? MAX_K : k;
+}
+
+/*
+ * set_tsc_maxsamples - Maximum number of samples attempting to find
+ *     K-best within some tolerance.
+ *     When exceeded, just return best sample found.
+ *     Default = 20
+ */
+void set_tsc_maxsamples(int maxsamples_arg) {
+    maxsamples = maxsamples_arg;
+}
+
+/*
+ * set_tsc_epsilon - Tolerance required for K-best
+ *     Default = 0.01
+ */
+void set_tsc_epsilon(double epsilon_arg) {
+    epsilon = epsilon_arg;
+}
@@ -0,0 +1,48 @@
+/*
+ * tsc.h - Time a function f with the invariant time stamp counter
+ */
+#include <stdint.h>
+
+/* The test function takes a generic pointer as input */
+typedef void (*tsc_test_funct)(void *);
+
+/*
+ * Pin to the current CPU, check the TSC is invariant, calibrate its
+ * frequency and check the cpufreq governor. Call once before ftsc.
+ * Returns the measured TSC frequency in MHz.
+ */
+double init_tsc(int verbose);
+
+/* Give back the CPUs the process could run on before init_tsc */
+void unpin_tsc(void);
+
+/* Read the counter in ticks, serialized against earlier instructions */
+uint64_t tsc_start(void);
+
+/* Read the counter in ticks, after all earlier instructions finish */
+uint64_t tsc_stop(void);
+
+/* Ticks per second of tsc_start and tsc_stop */
+double tsc_hz(void);
+
+/* Estimate the running time of f(argp) in seconds with a K-best scheme */
+double ftsc(tsc_test_funct f, void *argp);
+
+/*
+ * set_tsc_k - Value of K in the K-best scheme
+ *     Default = 3
+ */
+void set_tsc_k(int k);
+
+/*
+ * set_tsc_maxsamples - Runs after which the best run is returned even
+ *     if the K best have not converged
+ *     Default = 20
+ */
+void set_tsc_maxsamples(int maxsamples_arg);
+
+/*
+ * set_tsc_epsilon - Tolerance required for K-best
+ *     Default = 0.01
+ */
+void set_tsc_epsilon(double epsilon_arg);